@@ -0,0 +1,366 @@
+/* Micro Tetris, benchmark of the engine and renderer hot paths
+ *
+ * Copyright (c) 2025  julmajustus <julmajustus@tutanota.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bot.h"
+#include "engine.h"
+#include "screen.h"
+
+#define GAMES    2000		/* scripted games per run, seeds 1..GAMES */
+#define SAMPLES  (1 << 18)	/* max frame latency samples kept */
+#define BOT_GAMES  20		/* autoplayer games, seeds 1..BOT_GAMES */
+#define BOT_PIECES 1000		/* shapes each, a good bot never loses */
+#define BEAM_GAMES 2		/* beam search games, it is much slower */
+
+/*
+ * Scripted player, the same for every run: each new shape gets a random
+ * number of rotations and a random column, then it is dropped and left
+ * for gravity to lock.
+ */
+struct script {
+	uint32_t state;
+	int      moves[16];
+	int      len, pos;
+};
+
+static uint32_t xorshift(uint32_t *s)
+{
+	*s ^= *s << 13;
+	*s ^= *s >> 17;
+	*s ^= *s << 5;
+
+	return *s;
+}
+
+static void script_init(struct script *sc, uint32_t seed)
+{
+	sc->state = seed * 2654435761u | 1;
+	sc->len = sc->pos = 0;
+}
+
+static int script_next(struct script *sc)
+{
+	if (sc->pos == sc->len) {
+		int rot = xorshift(&sc->state) % 4;
+		int dx  = (int)(xorshift(&sc->state) % 11) - 5;
+
+		sc->len = sc->pos = 0;
+		while (rot--)
+			sc->moves[sc->len++] = TETRIS_RROTATE;
+		for (; dx < 0; dx++)
+			sc->moves[sc->len++] = TETRIS_LEFT;
+		for (; dx > 0; dx--)
+			sc->moves[sc->len++] = TETRIS_RIGHT;
+		sc->moves[sc->len++] = TETRIS_DROP;
+		sc->moves[sc->len++] = TETRIS_TICK;
+	}
+
+	return sc->moves[sc->pos++];
+}
+
+/* Next scripted input, a TICK is repeated until the shape locks */
+static int script_step(struct tetris_game *game, struct script *sc)
+{
+	int input = script_next(sc);
+	int events;
+
+	do {
+		events = tetris_step(game, input);
+	} while (input == TETRIS_TICK && !game->over && !(events & TETRIS_LOCKED));
+
+	return events;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Whole games, tetris_step() only, inputs from the script */
+static void bench_engine(const char *name, int flags)
+{
+	long steps = 0, pieces = 0, lines = 0;
+	uint64_t start, locks = 0;
+	double sec, lock_sec;
+	int seed;
+
+	start = now_ns();
+	for (seed = 1; seed <= GAMES; seed++) {
+		struct tetris_game game;
+		struct script sc;
+
+		tetris_init(&game, seed, flags);
+		script_init(&sc, seed);
+		while (!game.over) {
+			int input = script_next(&sc);
+
+			if (input == TETRIS_TICK) {
+				/* Lock delay frames, then the one locking the shape */
+				uint64_t t;
+				int events;
+
+				do {
+					t = now_ns();
+					events = tetris_step(&game, input);
+					t = now_ns() - t;
+					steps++;
+				} while (!game.over && !(events & TETRIS_LOCKED));
+				locks += t;
+			} else {
+				tetris_step(&game, input);
+				steps++;
+			}
+		}
+		pieces += game.pieces;
+		lines  += game.lines;
+	}
+	sec = (now_ns() - start) / 1e9;
+	lock_sec = locks / 1e9;
+
+	printf("engine %-9s %10.0f shapes/s %9.0f lines/s %11.0f steps/s %6.1f ns/lock\n",
+	       name, pieces / sec, lines / sec, steps / sec, lock_sec * 1e9 / pieces);
+}
+
+/* Every shape at every position of a half filled board */
+static void bench_fits(const char *name, int flags)
+{
+	struct tetris_game game;
+	struct script sc;
+	const long rounds = 2000;
+	uint64_t start;
+	long calls = 0, hits = 0;
+	long r;
+
+	tetris_init(&game, 1, flags);
+	script_init(&sc, 1);
+	while (!game.over && game.pieces < 12)
+		script_step(&game, &sc);
+
+	start = now_ns();
+	for (r = 0; r < rounds; r++) {
+		int shape, pos;
+
+		for (shape = 0; shape < TETRIS_SHAPES; shape++) {
+			for (pos = B_COLS; pos < (game.height + 1) * B_COLS; pos++) {
+				hits += tetris_fits(&game, shape, pos);
+				calls++;
+			}
+		}
+	}
+
+	printf("fits   %-9s %10.2f ns/call (%ld of %ld fit)\n", name,
+	       (now_ns() - start) / (double)calls, hits / rounds, calls / rounds);
+}
+
+/* Landing row of every shape in every column, from the top row */
+static void bench_landing(const char *name, int steps)
+{
+	struct tetris_game game;
+	struct script sc;
+	const long rounds = 20000;
+	uint64_t start;
+	long calls = 0, sum = 0;
+	long r;
+
+	tetris_init(&game, 1, 0);
+	script_init(&sc, 1);
+	while (!game.over && game.pieces < 12)
+		script_step(&game, &sc);
+
+	start = now_ns();
+	for (r = 0; r < rounds; r++) {
+		int shape, x;
+
+		for (shape = 0; shape < TETRIS_SHAPES; shape++) {
+			for (x = 1; x <= game.width; x++) {
+				int pos = B_COLS + x;
+
+				if (!tetris_fits(&game, shape, pos))
+					continue;
+				if (steps) {
+					while (tetris_fits(&game, shape, pos + B_COLS))
+						pos += B_COLS;
+				} else {
+					pos = tetris_landing(&game, shape, pos);
+				}
+				sum += pos;
+				calls++;
+			}
+		}
+	}
+
+	printf("land   %-9s %10.2f ns/call (%ld)\n", name,
+	       (now_ns() - start) / (double)calls, sum / rounds);
+}
+
+/* Autoplayer games, time spent in bot_plan() for each shape */
+static void bench_bot(const char *name, int lookahead, int games)
+{
+	uint64_t plans = 0, total = 0;
+	long lines = 0, nodes = bot_nodes();
+	int seed;
+
+	for (seed = 1; seed <= games; seed++) {
+		struct tetris_game game;
+
+		tetris_init(&game, seed, 0);
+		while (!game.over && game.pieces < BOT_PIECES) {
+			int moves[BOT_MOVES], len, i;
+			uint64_t t = now_ns();
+
+			len = bot_plan(&game, lookahead, moves);
+			total += now_ns() - t;
+			plans++;
+
+			for (i = 0; i < len; i++)
+				tetris_step(&game, moves[i]);
+			while (!(tetris_step(&game, TETRIS_TICK) & TETRIS_LOCKED))
+				;
+		}
+		lines += game.lines;
+	}
+
+	printf("bot    %-9s %10.0f plans/s %8.1f us/plan %7.0f lines/game",
+	       name, plans / (total / 1e9), total / 1e3 / plans, lines / (double)games);
+	nodes = bot_nodes() - nodes;
+	if (nodes)
+		printf(" %9.0f nodes/s", nodes / (total / 1e9));
+	putchar('\n');
+}
+
+/* Scripted games drawn after every step, like the front end does */
+static void bench_render(const char *name, int fd, int profile)
+{
+	static struct screen scr;
+	static uint64_t sample[SAMPLES];
+	long frames = 0, n = 0;
+	uint64_t total = 0;
+	int seed;
+
+	screen_init(&scr, fd);
+	scr.profile = profile;
+	for (seed = 1; seed <= GAMES / 10; seed++) {
+		struct tetris_game game;
+		struct script sc;
+
+		tetris_init(&game, seed, 0);
+		script_init(&sc, seed);
+		screen_invalidate(&scr);
+		while (!game.over) {
+			uint64_t t = now_ns();
+
+			screen_update(&scr, &game);
+			t = now_ns() - t;
+			total += t;
+			if (n < SAMPLES)
+				sample[n++] = t;
+			frames++;
+
+			script_step(&game, &sc);
+		}
+	}
+
+	qsort(sample, n, sizeof(sample[0]), cmp_u64);
+	printf("render %-9s %10.0f frames/s %7.1f bytes/frame  p50 %6.0f ns  p99 %6.0f ns\n",
+	       name, frames / (total / 1e9), scr.bytes / (double)frames,
+	       (double)sample[n / 2], (double)sample[n * 99 / 100]);
+}
+
+/*
+ * The choice of bot_use(NULL) on a CPU without avx2: sse2 on x86, the
+ * next in order of preference, not scalar.  Returns 1 if it picks wrong.
+ */
+static int check_select(void)
+{
+	const char *name;
+	int rc = 0;
+
+	bot_mask("avx2");
+	name = bot_use(NULL);
+	printf("select without avx2: %s\n", name ? name : "none");
+#if defined(__x86_64__) || defined(__i386__)
+	if (!name || strcmp(name, "sse2"))
+		rc = 1;
+#else
+	if (!name)
+		rc = 1;
+#endif
+	bot_mask(NULL);
+	bot_use(NULL);
+
+	return rc;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *evals[] = { "scalar", "sse2", "avx2", "neon" };
+	size_t i;
+	int fd;
+
+	if (argc > 1 && !strcmp(argv[1], "select"))
+		return check_select();
+
+	printf("Micro Tetris benchmark, %d scripted games, seeds 1-%d\n\n", GAMES, GAMES);
+
+	bench_engine("bitboard", 0);
+	bench_engine("legacy", TETRIS_LEGACY);
+	bench_engine("7-bag", TETRIS_BAG);
+	bench_fits("bitboard", 0);
+	bench_fits("legacy", TETRIS_LEGACY);
+	bench_landing("heights", 0);
+	bench_landing("stepping", 1);
+	for (i = 0; i < sizeof(evals) / sizeof(evals[0]); i++) {
+		if (!bot_use(evals[i]))
+			continue;
+		bench_bot(evals[i], 1, BOT_GAMES);
+	}
+	bot_use(NULL);
+	if (check_select())
+		return 1;
+	bench_bot("preview", 2, BOT_GAMES);
+	bench_bot("beam", 1 + TETRIS_PREVIEWS, BEAM_GAMES);
+
+	bench_render("null", -1, SCREEN_ANSI16);
+	bench_render("mono", -1, SCREEN_MONO);
+	bench_render("truecolor", -1, SCREEN_TRUECOLOR);
+	fd = open("/dev/null", O_WRONLY);
+	if (fd == -1) {
+		perror("/dev/null");
+		return 1;
+	}
+	bench_render("/dev/null", fd, SCREEN_ANSI16);
+	close(fd);
+
+	return 0;
+}
@@ -0,0 +1,704 @@
+/* Micro Tetris, placement search for the autoplayer
+ *
+ * Copyright (c) 2025  julmajustus <julmajustus@tutanota.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "bot.h"
+
+/*
+ * Weights of the board features, from Yiyuan Lee's genetic tuning of
+ * the classic heuristic: heights, holes and bumpiness are penalized,
+ * cleared lines rewarded.
+ */
+#define W_HEIGHT  -0.510066
+#define W_LINES    0.760666
+#define W_HOLES   -0.35663
+#define W_BUMPS   -0.184483
+
+/* Lock shape where it lands, at pos, returns lines cleared */
+static int land(uint16_t *rows, int height, int shape, int pos)
+{
+	const uint16_t *m = tetris_shapes[shape].mask;
+	const int x = pos % B_COLS;
+	uint16_t *row = &rows[pos / B_COLS - 1];
+	int y, dst, lines = 0;
+
+	row[0] |= m[0] << x >> 1;
+	row[1] |= m[1] << x >> 1;
+	row[2] |= m[2] << x >> 1;
+	row[3] |= m[3] << x >> 1;
+
+	/* Compact like the engine, vacated rows get a copy of row 0 */
+	for (y = dst = height; y > 0; y--) {
+		if (rows[y] == BB_FULL) {
+			lines++;
+			continue;
+		}
+		rows[dst--] = rows[y];
+	}
+	for (; dst > 0; dst--)
+		rows[dst] = rows[0];
+
+	return lines;
+}
+
+/*
+ * Board features, computed top down with a running mask of covered
+ * cells, i.e. the cell or one above it is filled.  Summed over all
+ * rows, its popcount is the aggregate height, covered but empty cells
+ * are holes, and covered cells next to uncovered ones are the
+ * bumpiness, the sum of height differences between columns.
+ *
+ * Candidate boards are evaluated LANES at a time, transposed so that
+ * row y of every board is one vector of 16-bit lanes, with SSE2, AVX2
+ * or NEON when the CPU has them.  Cells are the columns 1..width of a
+ * row, pairs the columns 1..width-1, each against the one to its right.
+ */
+#define LANES   16
+#define CELLS(w) ((1u << ((w) + 1)) - 2)
+#define PAIRS(w) ((1u << (w)) - 2)
+
+enum { F_HEIGHT, F_HOLES, F_BUMPS, FEATURES };
+
+typedef void (*features_fn)(const uint16_t (*rows)[LANES], int bottom, int width,
+			    uint16_t (*f)[LANES]);
+
+static void features_scalar(const uint16_t (*rows)[LANES], int bottom, int width,
+			    uint16_t (*f)[LANES])
+{
+	const unsigned int cells_mask = CELLS(width), pairs_mask = PAIRS(width);
+	int i, y;
+
+	for (i = 0; i < LANES; i++) {
+		unsigned int covered = 0;
+		int height = 0, holes = 0, bumps = 0;
+
+		for (y = 0; y < bottom; y++) {
+			unsigned int cells = rows[y][i] & cells_mask;
+
+			covered |= cells;
+			height += __builtin_popcount(covered);
+			holes  += __builtin_popcount(covered & ~cells);
+			bumps  += __builtin_popcount((covered ^ covered >> 1) & pairs_mask);
+		}
+
+		f[F_HEIGHT][i] = height;
+		f[F_HOLES][i]  = holes;
+		f[F_BUMPS][i]  = bumps;
+	}
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_X86
+
+/* Popcount of each 16-bit lane, by halves, nibbles, bytes */
+__attribute__((target("sse2")))
+static inline __m128i pop16_sse2(__m128i v)
+{
+	v = _mm_sub_epi16(v, _mm_and_si128(_mm_srli_epi16(v, 1), _mm_set1_epi16(0x5555)));
+	v = _mm_add_epi16(_mm_and_si128(v, _mm_set1_epi16(0x3333)),
+			  _mm_and_si128(_mm_srli_epi16(v, 2), _mm_set1_epi16(0x3333)));
+	v = _mm_and_si128(_mm_add_epi16(v, _mm_srli_epi16(v, 4)), _mm_set1_epi16(0x0f0f));
+
+	return _mm_and_si128(_mm_add_epi16(v, _mm_srli_epi16(v, 8)), _mm_set1_epi16(0x1f));
+}
+
+__attribute__((target("sse2")))
+static void features_sse2(const uint16_t (*rows)[LANES], int bottom, int width,
+			  uint16_t (*f)[LANES])
+{
+	const __m128i cells_mask = _mm_set1_epi16(CELLS(width));
+	const __m128i pairs_mask = _mm_set1_epi16(PAIRS(width));
+	int i, y;
+
+	for (i = 0; i < LANES; i += 8) {
+		__m128i covered = _mm_setzero_si128();
+		__m128i height = covered, holes = covered, bumps = covered;
+
+		for (y = 0; y < bottom; y++) {
+			__m128i cells = _mm_and_si128(_mm_loadu_si128((const __m128i *)&rows[y][i]), cells_mask);
+
+			covered = _mm_or_si128(covered, cells);
+			height  = _mm_add_epi16(height, pop16_sse2(covered));
+			holes   = _mm_add_epi16(holes, pop16_sse2(_mm_andnot_si128(cells, covered)));
+			bumps   = _mm_add_epi16(bumps, pop16_sse2(_mm_and_si128(pairs_mask,
+						_mm_xor_si128(covered, _mm_srli_epi16(covered, 1)))));
+		}
+
+		_mm_storeu_si128((__m128i *)&f[F_HEIGHT][i], height);
+		_mm_storeu_si128((__m128i *)&f[F_HOLES][i], holes);
+		_mm_storeu_si128((__m128i *)&f[F_BUMPS][i], bumps);
+	}
+}
+
+__attribute__((target("avx2")))
+static inline __m256i pop16_avx2(__m256i v)
+{
+	v = _mm256_sub_epi16(v, _mm256_and_si256(_mm256_srli_epi16(v, 1), _mm256_set1_epi16(0x5555)));
+	v = _mm256_add_epi16(_mm256_and_si256(v, _mm256_set1_epi16(0x3333)),
+			     _mm256_and_si256(_mm256_srli_epi16(v, 2), _mm256_set1_epi16(0x3333)));
+	v = _mm256_and_si256(_mm256_add_epi16(v, _mm256_srli_epi16(v, 4)), _mm256_set1_epi16(0x0f0f));
+
+	return _mm256_and_si256(_mm256_add_epi16(v, _mm256_srli_epi16(v, 8)), _mm256_set1_epi16(0x1f));
+}
+
+/* All LANES boards in one register per row */
+__attribute__((target("avx2")))
+static void features_avx2(const uint16_t (*rows)[LANES], int bottom, int width,
+			  uint16_t (*f)[LANES])
+{
+	const __m256i cells_mask = _mm256_set1_epi16(CELLS(width));
+	const __m256i pairs_mask = _mm256_set1_epi16(PAIRS(width));
+	__m256i covered = _mm256_setzero_si256();
+	__m256i height = covered, holes = covered, bumps = covered;
+	int y;
+
+	for (y = 0; y < bottom; y++) {
+		__m256i cells = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)rows[y]), cells_mask);
+
+		covered = _mm256_or_si256(covered, cells);
+		height  = _mm256_add_epi16(height, pop16_avx2(covered));
+		holes   = _mm256_add_epi16(holes, pop16_avx2(_mm256_andnot_si256(cells, covered)));
+		bumps   = _mm256_add_epi16(bumps, pop16_avx2(_mm256_and_si256(pairs_mask,
+					_mm256_xor_si256(covered, _mm256_srli_epi16(covered, 1)))));
+	}
+
+	_mm256_storeu_si256((__m256i *)f[F_HEIGHT], height);
+	_mm256_storeu_si256((__m256i *)f[F_HOLES], holes);
+	_mm256_storeu_si256((__m256i *)f[F_BUMPS], bumps);
+}
+
+static int have_sse2(void) { return __builtin_cpu_supports("sse2"); }
+static int have_avx2(void) { return __builtin_cpu_supports("avx2"); }
+#endif /* x86 */
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define HAVE_NEON
+
+/* Byte popcounts, pairwise added into the 16-bit lanes of acc */
+static inline uint16x8_t pop16_acc(uint16x8_t acc, uint16x8_t v)
+{
+	return vpadalq_u8(acc, vcntq_u8(vreinterpretq_u8_u16(v)));
+}
+
+static void features_neon(const uint16_t (*rows)[LANES], int bottom, int width,
+			  uint16_t (*f)[LANES])
+{
+	const uint16x8_t cells_mask = vdupq_n_u16(CELLS(width));
+	const uint16x8_t pairs_mask = vdupq_n_u16(PAIRS(width));
+	int i, y;
+
+	for (i = 0; i < LANES; i += 8) {
+		uint16x8_t covered = vdupq_n_u16(0);
+		uint16x8_t height = covered, holes = covered, bumps = covered;
+
+		for (y = 0; y < bottom; y++) {
+			uint16x8_t cells = vandq_u16(vld1q_u16(&rows[y][i]), cells_mask);
+
+			covered = vorrq_u16(covered, cells);
+			height  = pop16_acc(height, covered);
+			holes   = pop16_acc(holes, vbicq_u16(covered, cells));
+			bumps   = pop16_acc(bumps, vandq_u16(pairs_mask,
+						veorq_u16(covered, vshrq_n_u16(covered, 1))));
+		}
+
+		vst1q_u16(&f[F_HEIGHT][i], height);
+		vst1q_u16(&f[F_HOLES][i], holes);
+		vst1q_u16(&f[F_BUMPS][i], bumps);
+	}
+}
+#endif /* NEON */
+
+static int always(void) { return 1; }
+
+/* In order of preference */
+static const struct {
+	const char  *name;
+	features_fn  fn;
+	int        (*supported)(void);
+} evaluators[] = {
+#ifdef HAVE_X86
+	{ "avx2",   features_avx2,   have_avx2 },
+	{ "sse2",   features_sse2,   have_sse2 },
+#endif
+#ifdef HAVE_NEON
+	{ "neon",   features_neon,   always },
+#endif
+	{ "scalar", features_scalar, always },
+};
+
+static features_fn features = features_scalar;
+static unsigned    masked;	/* bit per evaluators[] entry, see bot_mask() */
+
+void bot_mask(const char *name)
+{
+	size_t i;
+
+	if (!name) {
+		masked = 0;
+		return;
+	}
+
+	for (i = 0; i < sizeof(evaluators) / sizeof(evaluators[0]); i++) {
+		if (!strcmp(name, evaluators[i].name))
+			masked |= 1u << i;
+	}
+}
+
+const char *bot_use(const char *name)
+{
+	size_t i;
+
+#ifdef HAVE_X86
+	__builtin_cpu_init();
+#endif
+	for (i = 0; i < sizeof(evaluators) / sizeof(evaluators[0]); i++) {
+		if (name && strcmp(name, evaluators[i].name))
+			continue;
+		if (!evaluators[i].supported() || (masked & (1u << i))) {
+			/* Asked for by name, or else the next best one */
+			if (name)
+				return NULL;
+			continue;
+		}
+
+		features = evaluators[i].fn;
+		return evaluators[i].name;
+	}
+
+	return NULL;
+}
+
+/*
+ * Candidate boards waiting to be evaluated, and the best one so far.
+ * With out set, the score of each is stored at out[tag] instead.
+ */
+struct batch {
+	const struct tetris_game *game;	/* size of the board */
+	uint16_t rows[B_MAX_HEIGHT][LANES];	/* row y of board i in rows[y - 1][i] */
+	int      lines[LANES];
+	int      rot[LANES];
+	int      x[LANES];
+	int      tag[LANES];
+	double  *out;
+	int      len;
+};
+
+struct best {
+	double   score;
+	int      rot, x;
+};
+
+static void consider(struct best *best, double score, int rot, int x)
+{
+	if (score > best->score) {
+		best->score = score;
+		best->rot = rot;
+		best->x = x;
+	}
+}
+
+static void evaluate(struct batch *b, struct best *best)
+{
+	uint16_t f[FEATURES][LANES];
+	int i;
+
+	if (!b->len)
+		return;
+
+	features((const uint16_t (*)[LANES])b->rows, b->game->height, b->game->width, f);
+	for (i = 0; i < b->len; i++) {
+		double score = W_HEIGHT * f[F_HEIGHT][i] + W_LINES * b->lines[i] +
+			W_HOLES * f[F_HOLES][i] + W_BUMPS * f[F_BUMPS][i];
+
+		if (b->out)
+			b->out[b->tag[i]] = score;
+		else
+			consider(best, score, b->rot[i], b->x[i]);
+	}
+	b->len = 0;
+}
+
+static void add(struct batch *b, struct best *best, const uint16_t *rows, int lines,
+		int rot, int x, int tag)
+{
+	int y;
+
+	for (y = 0; y < b->game->height; y++)
+		b->rows[y][b->len] = rows[y + 1];
+	b->lines[b->len] = lines;
+	b->rot[b->len] = rot;
+	b->x[b->len] = x;
+	b->tag[b->len] = tag;
+
+	if (++b->len == LANES)
+		evaluate(b, best);
+}
+
+/*
+ * The rows as a game of the same size, column heights and all, for the
+ * engine's tetris_placements() and tetris_landing().  Only the bitboard
+ * is filled in, board[] is left as is.
+ */
+static const struct tetris_game *view(struct tetris_game *v, const struct tetris_game *game,
+				      const uint16_t *rows)
+{
+	unsigned int cells = CELLS(game->width);
+	int y;
+
+	v->width  = game->width;
+	v->height = game->height;
+	v->flags  = 0;
+	memcpy(v->rows, rows, sizeof(v->rows));
+	memset(v->col_height, 0, sizeof(v->col_height));
+	for (y = 1; y <= game->height && cells; y++) {
+		unsigned int top = rows[y] & cells;
+
+		cells &= ~top;
+		while (top) {
+			v->col_height[__builtin_ctz(top)] = game->height + 1 - y;
+			top &= top - 1;
+		}
+	}
+
+	return v;
+}
+
+/*
+ * The placements of the engine a player can get to from pos: rotate in
+ * place, then step sideways, each step has to fit.  Shapes dropped from
+ * further down than the top row land where tetris_landing() says, under
+ * an overhang too.  Fills in how many rotations each takes, returns how
+ * many there are, in the engine's order, so ties go to the first.
+ */
+static int reachable(const struct tetris_game *v, int shape, int pos,
+		     struct tetris_placement out[TETRIS_PLACEMENTS], int rot[TETRIS_PLACEMENTS])
+{
+	const int row = pos / B_COLS * B_COLS;
+	int lo[4], hi[4];
+	int r, s = shape, i, n, turns, len = 0;
+
+	for (r = 0; r < 4; r++, s = tetris_shapes[s].next) {
+		if ((r && s == shape) || !tetris_fits(v, s, pos))
+			break;		/* rotation blocked, and so are the rest */
+		for (lo[r] = pos; tetris_fits(v, s, lo[r] - 1); lo[r]--)
+			;
+		for (hi[r] = pos; tetris_fits(v, s, hi[r] + 1); hi[r]++)
+			;
+	}
+	if (!(turns = r))
+		return 0;
+
+	n = tetris_placements(v, shape, out);
+	for (i = 0, s = shape, r = 0; i < n; i++) {
+		const int x = out[i].pos % B_COLS;
+		int at = out[i].pos;
+
+		while (out[i].shape != s) {
+			s = tetris_shapes[s].next;
+			r++;
+		}
+		if (r >= turns || row + x < lo[r] || row + x > hi[r])
+			continue;
+		if (row > B_COLS)
+			at = tetris_landing(v, s, row + x);
+		out[len].shape = s;
+		out[len].pos = at;
+		rot[len++] = r;
+	}
+
+	return len;
+}
+
+/*
+ * Try every placement reachable from pos, see reachable().  With a next
+ * shape, each resulting board is searched again for it.  Candidates are
+ * scored in the order found, so ties go to the first.
+ */
+static void search(const struct tetris_game *game, const uint16_t *rows, int shape,
+		   int pos, int next, int lines, struct best *best)
+{
+	struct tetris_placement out[TETRIS_PLACEMENTS];
+	int rot[TETRIS_PLACEMENTS];
+	struct tetris_game v;
+	struct batch b;
+	int i, n;
+
+	memset(&b, 0, sizeof(b));
+	b.game = game;
+	n = reachable(view(&v, game, rows), shape, pos, out, rot);
+	for (i = 0; i < n; i++) {
+		uint16_t tmp[B_ROWS + 1];
+		const int x = out[i].pos % B_COLS;
+		int l;
+
+		memcpy(tmp, rows, sizeof(tmp));
+		l = lines + land(tmp, game->height, out[i].shape, out[i].pos);
+		if (next >= 0) {
+			struct best sub = { -1e30, -1, 0 };
+
+			search(game, tmp, next, B_START(game), -1, l, &sub);
+			consider(best, sub.score, rot[i], x);
+		} else {
+			add(&b, best, tmp, l, rot[i], x, 0);
+		}
+	}
+
+	evaluate(&b, best);
+}
+
+/*
+ * Beam search, lookahead 3 and up: the falling shape and the queue after
+ * it are placed one level at a time, keeping the BEAM_WIDTH best boards
+ * of each level to expand for the next shape.  Boards reached twice in a
+ * level, by placing the same shapes in another order or spot, are only
+ * expanded once, found by their Zobrist hash in a table of the level.
+ *
+ * Nothing is allocated while searching.  A thread's arena holds the two
+ * beams, the candidates of a level and the table, reset for each move.
+ * Candidates keep no rows, only how the parent board gets them, and the
+ * few kept are dropped again, into the beam of the next level.
+ */
+#define BEAM_WIDTH  32
+#define BEAM_KIDS   TETRIS_PLACEMENTS	/* of one shape, at most */
+#define BEAM_TABLE  8192		/* power of two, > BEAM_WIDTH * BEAM_KIDS */
+
+struct node {
+	uint16_t rows[B_ROWS + 1];
+	uint64_t hash;
+	int      lines;			/* cleared on the way here */
+	int      rot, x;		/* first move, of the falling shape */
+};
+
+struct cand {
+	double   score;
+	uint64_t hash;
+	int      parent;		/* in the beam above */
+	int      shape, pos;		/* where it lands on the parent */
+	int      lines;
+	int      rot, x;
+	int      order;			/* found, ties go to the first */
+};
+
+static _Thread_local struct arena {
+	struct node nodes[2][BEAM_WIDTH];
+	struct cand cand[BEAM_WIDTH * BEAM_KIDS];
+	double      score[BEAM_WIDTH * BEAM_KIDS];
+	uint64_t    table[BEAM_TABLE];
+	uint32_t    stamp[BEAM_TABLE];	/* level a table slot is from */
+	uint32_t    level;
+	long        nodes_seen;
+	struct tetris_game      view;	/* of the node being expanded */
+	struct tetris_placement out[TETRIS_PLACEMENTS];
+} arena;
+
+/* Key of a cell, SplitMix64 of its index, y * B_COLS + x */
+static inline uint64_t zobrist(unsigned int cell)
+{
+	uint64_t z = (cell + 1) * 0x9e3779b97f4a7c15ULL;
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+	return z ^ (z >> 31);
+}
+
+static uint64_t zobrist_board(const uint16_t *rows, int width, int height)
+{
+	uint64_t hash = 0;
+	int y;
+
+	for (y = 1; y <= height; y++) {
+		unsigned int cells = rows[y] & CELLS(width);
+
+		while (cells) {
+			hash ^= zobrist(y * B_COLS + __builtin_ctz(cells));
+			cells &= cells - 1;
+		}
+	}
+
+	return hash;
+}
+
+/* The four cells of a shape at pos, hashed the same way */
+static uint64_t zobrist_shape(int shape, int pos)
+{
+	const signed char *off = tetris_shapes[shape].off;
+
+	return zobrist(pos) ^ zobrist(pos + off[0]) ^ zobrist(pos + off[1]) ^
+		zobrist(pos + off[2]);
+}
+
+/* Returns 1 if hash is already in this level's table, else adds it */
+static int seen(struct arena *a, uint64_t hash)
+{
+	unsigned int i = hash & (BEAM_TABLE - 1);
+
+	while (a->stamp[i] == a->level) {
+		if (a->table[i] == hash)
+			return 1;
+		i = (i + 1) & (BEAM_TABLE - 1);
+	}
+	a->stamp[i] = a->level;
+	a->table[i] = hash;
+
+	return 0;
+}
+
+static void next_level(struct arena *a)
+{
+	if (++a->level == 0) {
+		memset(a->stamp, 0, sizeof(a->stamp));
+		a->level = 1;
+	}
+}
+
+static int cmp_cand(const void *p1, const void *p2)
+{
+	const struct cand *c1 = p1, *c2 = p2;
+
+	if (c1->score != c2->score)
+		return c1->score < c2->score ? 1 : -1;
+
+	return c1->order - c2->order;
+}
+
+/* Every placement of shape on every node of the beam, scored */
+static int expand(const struct tetris_game *game, struct arena *a, const struct node *beam,
+		  int len, int shape, int pos, int first)
+{
+	struct batch b;
+	int i, n = 0;
+
+	b.game = game;
+	b.out = a->score;
+	b.len = 0;
+	for (i = 0; i < len; i++) {
+		const struct node *node = &beam[i];
+		int rot[TETRIS_PLACEMENTS];
+		int k, m;
+
+		m = reachable(view(&a->view, game, node->rows), shape, pos, a->out, rot);
+		for (k = 0; k < m; k++) {
+			struct cand *c = &a->cand[n];
+			uint16_t tmp[B_ROWS + 1];
+			int lines;
+
+			memcpy(tmp, node->rows, sizeof(tmp));
+			lines = land(tmp, game->height, a->out[k].shape, a->out[k].pos);
+			if (lines)
+				c->hash = zobrist_board(tmp, game->width, game->height);
+			else
+				c->hash = node->hash ^ zobrist_shape(a->out[k].shape, a->out[k].pos);
+			c->parent = i;
+			c->shape  = a->out[k].shape;
+			c->pos    = a->out[k].pos;
+			c->lines  = node->lines + lines;
+			c->rot    = first ? rot[k] : node->rot;
+			c->x      = first ? a->out[k].pos % B_COLS : node->x;
+			c->order  = n;
+			add(&b, NULL, tmp, c->lines, 0, 0, n++);
+		}
+	}
+	evaluate(&b, NULL);
+
+	for (i = 0; i < n; i++)
+		a->cand[i].score = a->score[i];
+	a->nodes_seen += n;
+
+	return n;
+}
+
+static int beam(const struct tetris_game *game, int depth, struct best *best)
+{
+	struct arena *a = &arena;
+	struct node *beam = a->nodes[0];
+	int len = 1, level;
+
+	memcpy(beam[0].rows, game->rows, sizeof(beam[0].rows));
+	beam[0].hash  = zobrist_board(game->rows, game->width, game->height);
+	beam[0].lines = 0;
+
+	for (level = 0; level < depth && len; level++) {
+		const int shape = level ? TETRIS_PEEK(game, level - 1) : game->shape;
+		const int pos = level ? B_START(game) : game->pos;
+		struct node *next = a->nodes[(level + 1) & 1];
+		int n, i;
+
+		n = expand(game, a, beam, len, shape, pos, !level);
+		if (!n)
+			break;		/* tops out, keep the best of the level above */
+		qsort(a->cand, n, sizeof(a->cand[0]), cmp_cand);
+		best->score = a->cand[0].score;
+		best->rot   = a->cand[0].rot;
+		best->x     = a->cand[0].x;
+
+		next_level(a);
+		for (i = len = 0; i < n && len < BEAM_WIDTH; i++) {
+			const struct cand *c = &a->cand[i];
+			struct node *node = &next[len];
+
+			if (seen(a, c->hash))
+				continue;
+
+			memcpy(node->rows, beam[c->parent].rows, sizeof(node->rows));
+			land(node->rows, game->height, c->shape, c->pos);
+			node->hash  = c->hash;
+			node->lines = c->lines;
+			node->rot   = c->rot;
+			node->x     = c->x;
+			len++;
+		}
+		beam = next;
+	}
+
+	return best->rot >= 0;
+}
+
+long bot_nodes(void)
+{
+	return arena.nodes_seen;
+}
+
+int bot_plan(const struct tetris_game *game, int lookahead, int moves[BOT_MOVES])
+{
+	const int next = lookahead > 1 ? TETRIS_PEEK(game, 0) : -1;
+	struct best best = { -1e30, -1, 0 };
+	int dx, len = 0;
+
+	if (game->over)
+		return 0;
+
+	if (lookahead > 2)
+		beam(game, lookahead > 1 + TETRIS_PREVIEWS ? 1 + TETRIS_PREVIEWS : lookahead, &best);
+	else
+		search(game, game->rows, game->shape, game->pos, next, 0, &best);
+	if (best.rot < 0)
+		return 0;
+
+	while (best.rot--)
+		moves[len++] = TETRIS_RROTATE;
+	for (dx = best.x - game->pos % B_COLS; dx < 0; dx++)
+		moves[len++] = TETRIS_LEFT;
+	for (; dx > 0; dx--)
+		moves[len++] = TETRIS_RIGHT;
+	moves[len++] = TETRIS_DROP;
+
+	return len;
+}
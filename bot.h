@@ -0,0 +1,49 @@
+/* Micro Tetris, placement search for the autoplayer
+ *
+ * Copyright (c) 2025  julmajustus <julmajustus@tutanota.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#ifndef TETRIS_BOT_H_
+#define TETRIS_BOT_H_
+
+#include "engine.h"
+
+#define BOT_MOVES 20		/* room for the longest plan */
+
+_Static_assert(3 + (B_MAX_WIDTH - 1) + 1 <= BOT_MOVES, "3 rotations, steps across the widest board, drop");
+
+/*
+ * Find the best placement of the falling shape, over every rotation and
+ * column, and with lookahead 2 also of the previewed shape after it.
+ * Lookahead 3 up to 1 + TETRIS_PREVIEWS is a beam search over that many
+ * shapes of the queue.
+ * Fills moves with TETRIS_* inputs that take the shape there, ending in
+ * TETRIS_DROP, and returns their number, 0 when nothing fits.
+ */
+int bot_plan(const struct tetris_game *game, int lookahead, int moves[BOT_MOVES]);
+
+/*
+ * Board evaluator, "avx2", "sse2", "neon" or "scalar", NULL for the best
+ * one this CPU supports.  Returns its name, or NULL if not available.
+ * Not thread safe, call before starting any bot threads.
+ */
+const char *bot_use(const char *name);
+
+/* Treat an evaluator as not supported by this CPU, NULL undoes all, for tests */
+void bot_mask(const char *name);
+
+/* Boards the beam search has scored in this thread, for benchmarks */
+long bot_nodes(void);
+
+#endif /* TETRIS_BOT_H_ */
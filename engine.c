@@ -0,0 +1,922 @@
+/* Micro Tetris, headless game engine
+ *
+ * Copyright (c) 1989  John Tromp <john.tromp@gmail.com>
+ * Copyright (c) 2009-2021  Joachim Wiberg <troglobit@gmail.com>
+ * Copyright (c) 2025  julmajustus <julmajustus@tutanota.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "engine.h"
+
+/*
+ * All rotations of the seven shapes: index of the next and previous
+ * rotation, three offsets from the center cell, and color.  Expanded
+ * once, at compile time, to the shape records below.  The previous
+ * rotations are typed in, make check holds them to next[prev[i]] == i.
+ */
+#define SHAPES(X)							\
+	X( 7,  7, TL, TC, MR, 2)	/* ""__   */			\
+	X( 8,  8, TR, TC, ML, 3)	/* __""   */			\
+	X( 9, 11, ML, MR, BC, 1)	/* "|"    */			\
+	X( 3,  3, TL, TC, ML, 4)	/* square */			\
+	X(12, 14, ML, BL, MR, 5)	/* |"""   */			\
+	X(15, 17, ML, BR, MR, 6)	/* """|   */			\
+	X(18, 18, ML, MR,  2, 7)	/* ---- sticks out */		\
+	X( 0,  0, TC, ML, BL, 2)	/* /    */			\
+	X( 1,  1, TC, MR, BR, 3)	/* \    */			\
+	X(10,  2, TC, MR, BC, 1)	/* |-   */			\
+	X(11,  9, TC, ML, MR, 1)	/* _|_  */			\
+	X( 2, 10, TC, ML, BC, 1)	/* -|   */			\
+	X(13,  4, TC, BC, BR, 5)	/* |_   */			\
+	X(14, 12, TR, ML, MR, 5)	/* ___| */			\
+	X( 4, 13, TL, TC, BC, 5)	/* "|   */			\
+	X(16,  5, TR, TC, BC, 6)	/* |"   */			\
+	X(17, 15, TL, MR, ML, 6)	/* |___ */			\
+	X( 5, 16, TC, BC, BL, 6)	/* _| */			\
+	X( 6,  6, TC, BC, 2 * B_COLS, 7) /* | sticks out */
+
+/*
+ * Row (dy) and column (dx) of an offset, they span dy -1..2, dx -1..2.
+ * A shape mask has one row per dy, the cell at dx in bit dx + 1, and
+ * is moved to column x with (mask << x) >> 1.
+ */
+#define OFF_DY(o)         (((o) + B_COLS + 1) / B_COLS - 1)
+#define OFF_DX(o)         ((o) - OFF_DY(o) * B_COLS)
+#define OFF_BIT(o, r)     (OFF_DY(o) == (r) - 1 ? 1 << (OFF_DX(o) + 1) : 0)
+#define SHAPE_ROW(a, b, c, r)						\
+	(OFF_BIT(0, r) | OFF_BIT(a, r) | OFF_BIT(b, r) | OFF_BIT(c, r))
+#define OFF_LOW(o, col)   (OFF_DX(o) == (col) - 1 ? OFF_DY(o) : -2)
+#define MAX(p, q)         ((p) > (q) ? (p) : (q))
+#define SHAPE_LOW(a, b, c, col)						\
+	MAX(MAX(OFF_LOW(0, col), OFF_LOW(a, col)), MAX(OFF_LOW(b, col), OFF_LOW(c, col)))
+#define SHAPE_REC(next, prev, a, b, c, color)				\
+	{ { a, b, c }, next, prev, color,				\
+	  { SHAPE_ROW(a, b, c, 0), SHAPE_ROW(a, b, c, 1),		\
+	    SHAPE_ROW(a, b, c, 2), SHAPE_ROW(a, b, c, 3) },		\
+	  { SHAPE_LOW(a, b, c, 0), SHAPE_LOW(a, b, c, 1),		\
+	    SHAPE_LOW(a, b, c, 2), SHAPE_LOW(a, b, c, 3) } },
+
+const struct tetris_shape tetris_shapes[TETRIS_SHAPES] = {
+	SHAPES(SHAPE_REC)
+};
+
+static const int score_table[5] = {
+	0,
+	40,
+	100,
+	300,
+	1200
+};
+
+/*
+ * Frames per row, by level.  Level 1 falls at the pace the old SIGALRM
+ * timer started with, 500 ms.  From level 17 on it is a row a frame.
+ */
+static const unsigned char gravity_table[] = {
+	30, 26, 22, 19, 16, 13, 11, 9, 7, 6, 5, 4, 3, 3, 2, 2, 1
+};
+
+/* Check if shape fits in the current position */
+static int fits_in(const struct tetris_game *game, int shape, int pos)
+{
+	const int *board = game->board;
+	const signed char *s = tetris_shapes[shape].off;
+
+	if (board[pos] || board[pos + s[0]] || board[pos + s[1]] || board[pos + s[2]])
+		return 0;
+
+	return 1;
+}
+
+/* Same check on the bitboard, one AND per row the shape spans */
+static int bb_fits_in(const struct tetris_game *game, int shape, int pos)
+{
+	const uint16_t *row = &game->rows[pos / B_COLS - 1];
+	const uint16_t *m = tetris_shapes[shape].mask;
+	const int x = pos % B_COLS;
+
+	return !((row[0] & (m[0] << x >> 1)) | (row[1] & (m[1] << x >> 1)) |
+		 (row[2] & (m[2] << x >> 1)) | (row[3] & (m[3] << x >> 1)));
+}
+
+static int fits(const struct tetris_game *game, int shape, int pos)
+{
+	if (game->flags & TETRIS_LEGACY)
+		return fits_in(game, shape, pos);
+
+	return bb_fits_in(game, shape, pos);
+}
+
+/*
+ * place shape at pos with color, and in the bitboard.  Row fill counts
+ * and column heights are kept up to date from the same row masks.
+ */
+static void place(struct tetris_game *game, int shape, int pos, int c)
+{
+	int *board = game->board;
+	const signed char *s = tetris_shapes[shape].off;
+	const int top = pos / B_COLS - 1;
+	const uint16_t *m = tetris_shapes[shape].mask;
+	const int x = pos % B_COLS;
+	int i;
+
+	board[pos] = c;
+	board[pos + s[0]] = c;
+	board[pos + s[1]] = c;
+	board[pos + s[2]] = c;
+
+	for (i = 0; i < 4; i++) {
+		unsigned int bits = m[i] << x >> 1;
+		const int height = game->height + 1 - (top + i);
+
+		if (!bits)
+			continue;
+
+		game->rows[top + i] |= bits;
+		game->row_fill[top + i] += __builtin_popcount(bits);
+		do {
+			int col = __builtin_ctz(bits);
+
+			if (game->col_height[col] < height)
+				game->col_height[col] = height;
+			bits &= bits - 1;
+		} while (bits);
+	}
+}
+
+static inline uint32_t rotl(uint32_t x, int k)
+{
+	return (x << k) | (x >> (32 - k));
+}
+
+/* xoshiro128** by Blackman and Vigna, same sequence on every platform */
+static inline uint32_t rng_next(uint32_t *s)
+{
+	const uint32_t result = rotl(s[1] * 5, 7) * 9;
+	const uint32_t t = s[1] << 9;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotl(s[3], 11);
+
+	return result;
+}
+
+/* Uniform in [0, range), Lemire's multiply and reject, no modulo bias */
+static inline uint32_t rng_range(uint32_t *s, uint32_t range)
+{
+	uint64_t m = (uint64_t)rng_next(s) * range;
+
+	if ((uint32_t)m < range) {
+		uint32_t threshold = -range % range;
+
+		while ((uint32_t)m < threshold)
+			m = (uint64_t)rng_next(s) * range;
+	}
+
+	return m >> 32;
+}
+
+/* Expand the seed with splitmix64, any seed, even 0, gives a good state */
+static void rng_seed(uint32_t *s, uint64_t seed)
+{
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		z ^= z >> 31;
+		s[2 * i]     = (uint32_t)z;
+		s[2 * i + 1] = (uint32_t)(z >> 32);
+	}
+}
+
+/* 7-bag, every shape once, in random order, before any repeats */
+static int bag_shape(struct tetris_game *game)
+{
+	int i, shape;
+
+	if (!game->bag_len) {
+		for (i = 0; i < 7; i++)
+			game->bag[i] = i;
+		game->bag_len = 7;
+	}
+
+	i = rng_range(game->rng, game->bag_len);
+	shape = game->bag[i];
+	game->bag[i] = game->bag[--game->bag_len];
+
+	return shape;
+}
+
+static int random_shape(struct tetris_game *game)
+{
+	if (game->flags & TETRIS_BAG)
+		return bag_shape(game);
+
+	return rng_range(game->rng, 7);
+}
+
+/* Take the next shape off the queue, topping it up to TETRIS_PREVIEWS */
+static int next_shape(struct tetris_game *game)
+{
+	int shape;
+
+	while (game->queued <= TETRIS_PREVIEWS) {
+		game->queue[(game->head + game->queued) & (TETRIS_QUEUE - 1)] = random_shape(game);
+		game->queued++;
+	}
+
+	shape = TETRIS_PEEK(game, 0);
+	game->head++;
+	game->queued--;
+	game->color = tetris_shapes[shape].color;
+
+	return shape;
+}
+
+static int row_full(const struct tetris_game *game, int y)
+{
+	if (game->flags & TETRIS_LEGACY) {
+		for (int x = 1; x <= game->width; ++x) {
+			if (!game->board[y * B_COLS + x])
+				return 0;
+		}
+		return 1;
+	}
+
+	return game->row_fill[y] == game->width;
+}
+
+/*
+ * Column heights after removing the full rows.  A column whose top cell
+ * survived drops by the number of rows removed below it, otherwise its
+ * new top is searched for, downwards.  Row 0 is never removed, and the
+ * rows vacated at the top are copies of it, so those columns stay.
+ */
+static void clear_heights(struct tetris_game *game, uint32_t full)
+{
+	int x;
+
+	for (x = 1; x <= game->width; x++) {
+		int height = game->col_height[x];
+		int y = game->height + 1 - height;
+
+		if (!height || !y)
+			continue;
+
+		height -= __builtin_popcount(full >> y);
+		if (full & (1u << y)) {
+			for (y = game->height + 1 - height; height && !(game->rows[y] & (1u << x)); y++)
+				height--;
+		}
+		game->col_height[x] = height;
+	}
+}
+
+/*
+ * Remove full lines, returns number of lines cleared.  Only the rows the
+ * shape just locked at pos can have become full, those are found first,
+ * then each run of surviving rows is moved down with a single memmove,
+ * bottom up.
+ */
+static int clear_lines(struct tetris_game *game, int pos)
+{
+	const int bottom = game->height;
+	const int top = pos / B_COLS - 1;
+	uint32_t full = 0;
+	int clears = 0;
+	int src, dst, y;
+
+	for (y = top > 1 ? top : 1; y <= top + 3 && y <= bottom; y++) {
+		if (row_full(game, y)) {
+			full |= 1u << y;
+			clears++;
+		}
+	}
+
+	game->cleared = full;
+	if (!clears)
+		return 0;
+
+	src = dst = bottom;
+	while (src > 0) {
+		int len = 0;
+
+		while (src > 0 && (full & (1u << src)))
+			src--;
+		while (src - len > 0 && !(full & (1u << (src - len))))
+			len++;
+
+		if (len && src != dst) {
+			memmove(&game->board[(dst - len + 1) * B_COLS],
+				&game->board[(src - len + 1) * B_COLS],
+				len * B_COLS * sizeof(game->board[0]));
+			memmove(&game->rows[dst - len + 1], &game->rows[src - len + 1],
+				len * sizeof(game->rows[0]));
+			memmove(&game->row_fill[dst - len + 1], &game->row_fill[src - len + 1],
+				len * sizeof(game->row_fill[0]));
+		}
+		src -= len;
+		dst -= len;
+	}
+
+	/* Vacated rows get a copy of row 0, like the old row by row shift did */
+	for (y = dst; y > 0; y--) {
+		memcpy(&game->board[y * B_COLS], game->board, B_COLS * sizeof(game->board[0]));
+		game->rows[y] = game->rows[0];
+		game->row_fill[y] = game->row_fill[0];
+	}
+	clear_heights(game, full);
+
+	return clears;
+}
+
+int tetris_gravity(int level)
+{
+	const int max = sizeof(gravity_table) / sizeof(gravity_table[0]);
+
+	if (level < 1)
+		level = 1;
+
+	return level > max ? 1 : gravity_table[level - 1];
+}
+
+/* New shape, gravity and lock delay start over */
+static void spawned(struct tetris_game *game)
+{
+	game->fall   = tetris_gravity(game->level);
+	game->rest   = 0;
+	game->resets = TETRIS_LOCK_RESETS;
+	game->held   = 0;
+}
+
+/* First rotation of a shape, the one it spawns in, is the lowest index */
+static int unrotated(int shape)
+{
+	int s = shape, min = shape;
+
+	do {
+		s = tetris_shapes[s].next;
+		if (s < min)
+			min = s;
+	} while (s != shape);
+
+	return min;
+}
+
+/*
+ * Put the falling shape on hold, unrotated, and bring in the one held
+ * before, or the next one if none.  Not again before the next lock.
+ */
+static int hold(struct tetris_game *game)
+{
+	int shape = unrotated(game->shape);
+
+	if (game->held)
+		return 0;
+
+	if (game->hold < 0) {
+		game->shape = next_shape(game);
+	} else {
+		game->shape = game->hold;
+		game->color = tetris_shapes[game->shape].color;
+	}
+	game->hold = shape;
+	spawned(game);
+	game->held = 1;
+
+	if (!fits(game, game->shape, game->pos = B_START(game))) {
+		game->over = 1;
+		return TETRIS_OVER;
+	}
+
+	return 0;
+}
+
+/* A resting shape was moved or rotated, it gets the full delay again */
+static void moved(struct tetris_game *game)
+{
+	if (game->rest && game->resets) {
+		game->rest = 0;
+		game->resets--;
+	}
+}
+
+/* Shape cannot fall any further, lock it and bring in the next one */
+static int lock(struct tetris_game *game)
+{
+	int events = TETRIS_LOCKED;
+	int clears;
+
+	place(game, game->shape, game->pos, game->color);
+	game->pieces++;
+	clears = clear_lines(game, game->pos);
+	if (clears > 0) {
+		double ofcheck = game->points + score_table[clears] * game->level;
+
+		if (ofcheck > LONG_MAX) {
+			game->over = 1;
+			return events | TETRIS_WON;
+		}
+
+		game->points += score_table[clears] * game->level;
+		game->lines_cleared += clears;
+		game->lines += clears;
+		events |= TETRIS_CLEARED;
+	}
+
+	/* Update points and level */
+	while (game->lines_cleared >= 10) {
+		game->lines_cleared -= 10;
+		game->level++;
+	}
+
+	game->shape = next_shape(game);
+	spawned(game);
+	if (!fits(game, game->shape, game->pos = B_START(game))) {
+		game->over = 1;
+		events |= TETRIS_OVER;
+	}
+
+	return events;
+}
+
+/* Does shape fit at pos, on the board of this game? */
+int tetris_fits(const struct tetris_game *game, int shape, int pos)
+{
+	return fits(game, shape, pos);
+}
+
+/*
+ * Row of the center when shape, centered in column x, comes straight
+ * down from above the stack onto it.  Each column it covers stops it
+ * one row above that column's top, less the dy of its lowest cell.
+ */
+static int surface(const struct tetris_game *game, int shape, int x)
+{
+	const signed char *bottom = tetris_shapes[shape].bottom;
+	int col, y = B_ROWS;
+
+	for (col = 0; col < 4; col++) {
+		int top;
+
+		if (bottom[col] < -1)
+			continue;
+
+		top = game->height + 1 - game->col_height[x + col - 1];
+		if (top - 1 - bottom[col] < y)
+			y = top - 1 - bottom[col];
+	}
+
+	return y;
+}
+
+/*
+ * Where shape at pos locks when dropped, without stepping it down row by
+ * row.  Only a shape already tucked under the top of a column it covers
+ * is stepped down, the stack above it says nothing about what is below.
+ */
+int tetris_landing(const struct tetris_game *game, int shape, int pos)
+{
+	const int x = pos % B_COLS;
+	const int y = surface(game, shape, x);
+
+	if (y >= pos / B_COLS)
+		return y * B_COLS + x;
+
+	while (fits(game, shape, pos + B_COLS))
+		pos += B_COLS;
+
+	return pos;
+}
+
+/*
+ * Every rotation of shape in every column it fits in, where it comes to
+ * rest dropped straight down from the top row, in one pass over the
+ * columns for each.  Returns the number of placements in out.
+ */
+int tetris_placements(const struct tetris_game *game, int shape,
+		      struct tetris_placement out[TETRIS_PLACEMENTS])
+{
+	const unsigned int walls = ~((1u << (game->width + 1)) - 2);
+	int s = shape, n = 0;
+
+	do {
+		const uint16_t *m = tetris_shapes[s].mask;
+		const unsigned int cols = m[0] | m[1] | m[2] | m[3];
+		int x;
+
+		for (x = 1; x <= game->width; x++) {
+			int pos;
+
+			if ((cols << x >> 1) & walls)
+				continue;
+
+			pos = surface(game, s, x) * B_COLS + x;
+			if (pos < B_COLS) {
+				/* Stack up to the top row, from where shapes spawn */
+				pos = B_COLS + x;
+				if (!fits(game, s, pos))
+					continue;
+				pos = tetris_landing(game, s, pos);
+			}
+
+			out[n].shape = s;
+			out[n].pos = pos;
+			n++;
+		}
+		s = tetris_shapes[s].next;
+	} while (s != shape);
+
+	return n;
+}
+
+/* Restart, keeps the RNG state and the queued shapes, not the held one */
+void tetris_reset(struct tetris_game *game)
+{
+	int i;
+
+	game->level = 1;
+	game->points = 0;
+	game->lines_cleared = 0;
+	game->lines = 0;
+	game->pieces = 0;
+	game->pos = B_START(game);
+	game->over = 0;
+	game->cleared = 0;
+	game->hold = -1;
+
+	/* Initialize board, grey border, used to be white(7) */
+	for (i = 0; i < B_SIZE; i++) {
+		const int x = i % B_COLS;
+
+		game->board[i] = !x || x > game->width || i / B_COLS > game->height ? 60 : 0;
+	}
+
+	/* Same border in the bitboard, plus one row of padding below */
+	for (i = 0; i <= game->height; i++) {
+		game->rows[i] = BB_WALL(game->width);
+		game->row_fill[i] = 0;
+	}
+	for (; i < B_ROWS + 1; i++) {
+		game->rows[i] = BB_FULL;
+		game->row_fill[i] = game->width;
+	}
+	memset(game->col_height, 0, sizeof(game->col_height));
+
+	game->shape = next_shape(game);
+	spawned(game);
+}
+
+/*
+ * Start a new game on a board of width x height, flags are TETRIS_BAG
+ * and TETRIS_LEGACY.  Returns -1 if the size is out of range.
+ */
+int tetris_init_size(struct tetris_game *game, uint64_t seed, int flags, int width, int height)
+{
+	if (width < B_MIN_WIDTH || width > B_MAX_WIDTH ||
+	    height < B_MIN_HEIGHT || height > B_MAX_HEIGHT)
+		return -1;
+
+	game->width = width;
+	game->height = height;
+	game->seed = seed;
+	game->flags = flags;
+	rng_seed(game->rng, seed);
+	game->bag_len = 0;
+	game->head = game->queued = 0;
+	tetris_reset(game);
+
+	return 0;
+}
+
+/* Start a new game on the classic board */
+void tetris_init(struct tetris_game *game, uint64_t seed, int flags)
+{
+	tetris_init_size(game, seed, flags, B_WIDTH, B_HEIGHT);
+}
+
+/*
+ * Push the stack up by lines rows of garbage, grey like the border and
+ * with a hole at column hole, 1..width, e.g. sent by an opponent.  The falling
+ * shape is moved up out of the way.  Returns TETRIS_OVER if the stack
+ * or the shape is pushed off the top.
+ */
+int tetris_add_garbage(struct tetris_game *game, int lines, int hole)
+{
+	int keep, x, y;
+
+	if (game->over || lines < 1 || hole < 1 || hole > game->width)
+		return 0;
+	if (lines > game->height)
+		lines = game->height;
+	keep = game->height - lines;
+
+	for (y = 1; y <= lines; y++) {
+		if (game->row_fill[y]) {
+			game->over = 1;
+			return TETRIS_OVER;
+		}
+	}
+
+	memmove(&game->board[B_COLS], &game->board[(1 + lines) * B_COLS],
+		keep * B_COLS * sizeof(game->board[0]));
+	memmove(&game->rows[1], &game->rows[1 + lines], keep * sizeof(game->rows[0]));
+	memmove(&game->row_fill[1], &game->row_fill[1 + lines], keep * sizeof(game->row_fill[0]));
+
+	for (y = keep + 1; y <= game->height; y++) {
+		for (x = 1; x <= game->width; x++)
+			game->board[y * B_COLS + x] = x == hole ? 0 : 60;
+		game->rows[y] = BB_FULL & ~(1u << hole);
+		game->row_fill[y] = game->width - 1;
+	}
+
+	for (x = 1; x <= game->width; x++) {
+		if (game->col_height[x] || x != hole)
+			game->col_height[x] += lines;
+	}
+
+	while (!fits(game, game->shape, game->pos)) {
+		if (game->pos < 2 * B_COLS) {
+			game->over = 1;
+			return TETRIS_OVER;
+		}
+		game->pos -= B_COLS;
+	}
+
+	return 0;
+}
+
+/*
+ * Frames of TETRIS_TICK until gravity changes something, the shape falls
+ * or locks on the last one, those before only count.  A front end can
+ * sleep that long if no key comes in.  0 when the game is over.
+ */
+int tetris_idle(const struct tetris_game *game)
+{
+	if (game->over)
+		return 0;
+	if (fits(game, game->shape, game->pos + B_COLS))
+		return game->fall;
+
+	return TETRIS_LOCK_DELAY - game->rest;
+}
+
+/* Advance the game by one input, returns TETRIS_* events */
+int tetris_step(struct tetris_game *game, int input)
+{
+	int backup = game->shape;
+
+	if (game->over)
+		return 0;
+
+	switch (input) {
+	case TETRIS_TICK:
+		if (fits(game, game->shape, game->pos + B_COLS)) {
+			game->rest = 0;
+			if (--game->fall > 0)
+				break;
+			game->fall = tetris_gravity(game->level);
+			game->pos += B_COLS;
+			break;
+		}
+		if (++game->rest < TETRIS_LOCK_DELAY)
+			break;
+		return lock(game);
+
+	case TETRIS_LEFT:
+		if (!fits(game, game->shape, --game->pos))
+			++game->pos;
+		else
+			moved(game);
+		break;
+
+	case TETRIS_RIGHT:
+		if (!fits(game, game->shape, ++game->pos))
+			--game->pos;
+		else
+			moved(game);
+		break;
+
+	case TETRIS_ROTATE:
+		game->shape = tetris_shapes[game->shape].prev;
+		if (!fits(game, game->shape, game->pos))
+			game->shape = backup;
+		else
+			moved(game);
+		break;
+
+	case TETRIS_RROTATE:
+		game->shape = tetris_shapes[game->shape].next;	/* Rotate */
+		/* Check if it fits, if not restore shape from backup */
+		if (!fits(game, game->shape, game->pos))
+			game->shape = backup;
+		else
+			moved(game);
+		break;
+
+	case TETRIS_DROP:
+		if (game->flags & TETRIS_LEGACY) {
+			for (; fits(game, game->shape, game->pos + B_COLS); ++game->points)
+				game->pos += B_COLS;
+		} else {
+			int pos = tetris_landing(game, game->shape, game->pos);
+
+			game->points += (pos - game->pos) / B_COLS;
+			game->pos = pos;
+		}
+		/* Locks on the next frame, no more sliding */
+		game->rest = TETRIS_LOCK_DELAY - 1;
+		game->resets = 0;
+		break;
+
+	case TETRIS_HOLD:
+		return hold(game);
+	}
+
+	return 0;
+}
+
+_Static_assert(sizeof(struct tetris_state) < 128, "tetris_state is not under two cache lines");
+
+/*
+ * Fields of tetris_state.bits, shift and width.  Gravity and the lock
+ * delay count to 30, lock resets to 15, less than 10 lines to a level.
+ */
+#define ST_FALL    0, 5
+#define ST_REST    5, 5
+#define ST_RESETS 10, 4
+#define ST_HELD   14, 1
+#define ST_OVER   15, 1
+#define ST_BAG    16, 3
+#define ST_LINES  19, 4
+
+#define ST_PUT(f, val)  ST_PUT_(f, val)
+#define ST_PUT_(shift, width, val) ((uint32_t)(val) << (shift))
+#define ST_GET(bits, f) ST_GET_(bits, f)
+#define ST_GET_(bits, shift, width) ((int)((bits) >> (shift) & ((1u << (width)) - 1)))
+
+/* Snapshot of game, rows below the board and padding zeroed, so snapshots compare */
+void tetris_save(const struct tetris_game *game, struct tetris_state *st)
+{
+	memset(st, 0, sizeof(*st));
+	memcpy(st->rows, game->rows, (game->height + 1) * sizeof(st->rows[0]));
+	memcpy(st->queue, game->queue, sizeof(st->queue));
+	st->head   = game->head & (TETRIS_QUEUE - 1);
+	st->queued = game->queued;
+	st->shape  = game->shape;
+	st->hold   = game->hold;
+	st->bits   = ST_PUT(ST_FALL, game->fall) | ST_PUT(ST_REST, game->rest) |
+		     ST_PUT(ST_RESETS, game->resets) | ST_PUT(ST_HELD, game->held) |
+		     ST_PUT(ST_OVER, game->over) | ST_PUT(ST_BAG, game->bag_len) |
+		     ST_PUT(ST_LINES, game->lines_cleared);
+	st->pos    = game->pos;
+	st->level  = game->level;
+	memcpy(st->bag, game->bag, sizeof(st->bag));
+	memcpy(st->rng, game->rng, sizeof(st->rng));
+	st->lines  = game->lines;
+	st->pieces = game->pieces;
+	st->points = game->points;
+}
+
+/*
+ * Back to a snapshot, row fill and column heights are derived from the
+ * rows.  Cells still filled keep their color, cells that come back, e.g.
+ * of cleared lines, are grey like garbage, tetris_undo() puts back the
+ * colors it has in the history.
+ */
+void tetris_load(struct tetris_game *game, const struct tetris_state *st)
+{
+	const unsigned int inside = BB_FULL & ~BB_WALL(game->width);
+	int x, y;
+
+	memset(game->col_height, 0, sizeof(game->col_height));
+	for (y = 0; y <= game->height; y++) {
+		const unsigned int cells = st->rows[y] & inside;
+		int *board = &game->board[y * B_COLS];
+
+		game->rows[y] = st->rows[y];
+		game->row_fill[y] = __builtin_popcount(cells);
+		for (x = 1; x <= game->width; x++) {
+			if (!(cells & (1u << x))) {
+				board[x] = 0;
+				continue;
+			}
+			if (!board[x])
+				board[x] = 60;
+			if (!game->col_height[x])
+				game->col_height[x] = game->height + 1 - y;
+		}
+	}
+
+	memcpy(game->queue, st->queue, sizeof(game->queue));
+	game->head   = st->head;
+	game->queued = st->queued;
+	game->shape  = st->shape;
+	game->color  = tetris_shapes[st->shape].color;
+	game->hold   = st->hold;
+	game->held   = ST_GET(st->bits, ST_HELD);
+	game->fall   = ST_GET(st->bits, ST_FALL);
+	game->rest   = ST_GET(st->bits, ST_REST);
+	game->resets = ST_GET(st->bits, ST_RESETS);
+	game->pos    = st->pos;
+	game->level  = st->level;
+	game->lines_cleared = ST_GET(st->bits, ST_LINES);
+	game->bag_len = ST_GET(st->bits, ST_BAG);
+	memcpy(game->bag, st->bag, sizeof(game->bag));
+	game->over   = ST_GET(st->bits, ST_OVER);
+	memcpy(game->rng, st->rng, sizeof(game->rng));
+	game->lines  = st->lines;
+	game->pieces = st->pieces;
+	game->points = st->points;
+	game->cleared = 0;
+}
+
+/* Color planes of the stack, grey (60) and garbage as 0 */
+static void save_colors(const struct tetris_game *game, uint16_t plane[3][B_MAX_HEIGHT + 1])
+{
+	int x, y;
+
+	for (y = 0; y <= game->height; y++) {
+		const int *board = &game->board[y * B_COLS];
+		unsigned int p0 = 0, p1 = 0, p2 = 0;
+
+		for (x = 1; x <= game->width; x++) {
+			const unsigned int c = board[x] == 60 ? 0 : board[x] & 7;
+
+			p0 |= (c & 1) << x;
+			p1 |= (c >> 1 & 1) << x;
+			p2 |= (c >> 2) << x;
+		}
+		plane[0][y] = p0;
+		plane[1][y] = p1;
+		plane[2][y] = p2;
+	}
+}
+
+/* Filled cells get their color back, after tetris_load() */
+static void load_colors(struct tetris_game *game, const uint16_t plane[3][B_MAX_HEIGHT + 1])
+{
+	int x, y;
+
+	for (y = 0; y <= game->height; y++) {
+		int *board = &game->board[y * B_COLS];
+
+		for (x = 1; x <= game->width; x++) {
+			const int c = (plane[0][y] >> x & 1) | (plane[1][y] >> x & 1) << 1 |
+				      (plane[2][y] >> x & 1) << 2;
+
+			if (board[x])
+				board[x] = c ? c : 60;
+		}
+	}
+}
+
+/* Remember the game as it is now, at the spawn of a shape */
+void tetris_push(struct tetris_history *h, const struct tetris_game *game)
+{
+	h->top = (h->top + 1) & (TETRIS_UNDO - 1);
+	tetris_save(game, &h->state[h->top]);
+	save_colors(game, h->color[h->top]);
+	if (h->len < TETRIS_UNDO)
+		h->len++;
+}
+
+/*
+ * Back to the spawn of the shape before the falling one, which is then
+ * the newest in the history again.  Returns -1 if there is none left.
+ */
+int tetris_undo(struct tetris_history *h, struct tetris_game *game)
+{
+	if (h->len < 2)
+		return -1;
+
+	h->len--;
+	h->top = (h->top - 1) & (TETRIS_UNDO - 1);
+	tetris_load(game, &h->state[h->top]);
+	load_colors(game, h->color[h->top]);
+
+	return 0;
+}
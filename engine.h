@@ -0,0 +1,219 @@
+/* Micro Tetris, headless game engine
+ *
+ * Copyright (c) 1989  John Tromp <john.tromp@gmail.com>
+ * Copyright (c) 2009-2021  Joachim Wiberg <troglobit@gmail.com>
+ * Copyright (c) 2025  julmajustus <julmajustus@tutanota.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#ifndef TETRIS_ENGINE_H_
+#define TETRIS_ENGINE_H_
+
+#include <stdint.h>
+
+/*
+ * The board.  Its size is chosen at tetris_init_size(), but cells are
+ * always laid out with the stride of the widest board, so shape offsets
+ * and bitboard masks stay compile time constants for every size.  Left
+ * of column 1 and right of width is wall, as is below row height, row 0
+ * is where new shapes stick out above the top.
+ */
+#define      B_COLS 16		/* stride, 14 columns plus the walls */
+#define      B_ROWS 32		/* room for 29 rows plus the floor */
+#define      B_SIZE (B_ROWS * B_COLS)
+#define      B_WIDTH  10	/* the classic board, default size */
+#define      B_HEIGHT 20
+#define      B_MAX_WIDTH  (B_COLS - 2)
+#define      B_MAX_HEIGHT (B_ROWS - 3)
+#define      B_MIN_WIDTH  4
+#define      B_MIN_HEIGHT 4
+#define      B_START(g) (B_COLS + (g)->width / 2)	/* spawn position of new shapes */
+
+#define TL     -B_COLS-1	/* top left */
+#define TC     -B_COLS		/* top center */
+#define TR     -B_COLS+1	/* top right */
+#define ML     -1		/* middle left */
+#define MR     1		/* middle right */
+#define BL     B_COLS-1		/* bottom left */
+#define BC     B_COLS		/* bottom center */
+#define BR     B_COLS+1		/* bottom right */
+
+/*
+ * Bitboard rows, one bit per column with column 0 and the ones right of
+ * the board set as walls, so a row is full when all bits are set.
+ */
+#define BB_WALL(w) (BB_FULL & ~(((1u << (w)) - 1) << 1))	/* 0xF801 for 10 */
+#define BB_FULL 0xFFFF
+
+/*
+ * One rotation of a shape.  Offsets of the three cells around the
+ * center, both rotation directions so either key is a single lookup,
+ * the bitboard rows dy -1..2 with the cell at dx in bit dx + 1, and the
+ * bottom profile: dy of the lowest cell in each column dx -1..2, -2 if
+ * the column is empty.
+ */
+#define TETRIS_SHAPES 19
+
+struct tetris_shape {
+	signed char   off[3];
+	unsigned char next;		/* rotate, KEY_RROTATE */
+	unsigned char prev;		/* rotate back, KEY_ROTATE */
+	unsigned char color;
+	uint16_t      mask[4];
+	signed char   bottom[4];
+};
+
+extern const struct tetris_shape tetris_shapes[TETRIS_SHAPES];
+
+/* Input to tetris_step(), TICK is one frame of gravity */
+#define TETRIS_TICK      0
+#define TETRIS_LEFT      1
+#define TETRIS_RIGHT     2
+#define TETRIS_ROTATE    3
+#define TETRIS_RROTATE   4
+#define TETRIS_DROP      5
+#define TETRIS_HOLD      6	/* swap with the held shape, once per shape */
+
+/*
+ * Gravity runs in frames of TETRIS_HZ, each one a TETRIS_TICK.  The
+ * shape falls a row every tetris_gravity() frames, and locks when it has
+ * rested for TETRIS_LOCK_DELAY frames.  Moving or rotating it restarts
+ * the delay, at most TETRIS_LOCK_RESETS times per shape, a drop locks it
+ * on the next frame.
+ */
+#define TETRIS_HZ          60
+#define TETRIS_LOCK_DELAY  30
+#define TETRIS_LOCK_RESETS 15
+
+/*
+ * Upcoming shapes, in a ring.  TETRIS_PREVIEWS are always drawn ahead,
+ * however many a front end shows, so the shape sequence of a seed is
+ * the same for any preview setting.
+ */
+#define TETRIS_QUEUE     8	/* ring size, power of two */
+#define TETRIS_PREVIEWS  6	/* shapes queued after the falling one */
+#define TETRIS_PEEK(g, n) ((g)->queue[((g)->head + (n)) & (TETRIS_QUEUE - 1)])
+
+/* Flags to tetris_init() */
+#define TETRIS_BAG       0x01	/* 7-bag randomizer, default uniform */
+#define TETRIS_LEGACY    0x02	/* collision on board[], not the bitboard */
+
+/* Events returned by tetris_step() */
+#define TETRIS_LOCKED    0x01	/* shape came to rest, next one spawned */
+#define TETRIS_CLEARED   0x02	/* one or more lines were cleared */
+#define TETRIS_OVER      0x04	/* new shape does not fit, game over */
+#define TETRIS_WON       0x08	/* points would overflow, game won */
+
+/*
+ * All state of one game.  There are no globals in the engine, so any
+ * number of games can run side by side, without a tty.
+ */
+struct tetris_game {
+	int      board[B_SIZE];	/* color of each cell, 60 is the border */
+	uint16_t rows[B_ROWS + 1];	/* occupancy bitboard, padded below */
+	uint8_t  row_fill[B_ROWS + 1];	/* filled cells per row, like rows[] */
+	uint8_t  col_height[B_COLS];	/* stack height of columns 1..width */
+	int      width, height;	/* playable columns and rows */
+	int      flags;		/* TETRIS_BAG, TETRIS_LEGACY */
+
+	int   shape;		/* current shape, index in shape table */
+	int   pos;		/* board index of its center */
+	int   color;
+	int   fall;		/* frames until it falls a row */
+	int   rest;		/* frames it has rested, towards the lock */
+	int   resets;		/* lock delay restarts left */
+
+	uint8_t  queue[TETRIS_QUEUE];	/* next shapes, see TETRIS_PEEK() */
+	unsigned head, queued;
+	int   hold;		/* held shape, -1 when none */
+	int   held;		/* hold used for the falling shape */
+
+	int   level;
+	long  points;
+	int   lines_cleared;	/* lines towards the next level */
+	long  lines;		/* total lines cleared */
+	long  pieces;		/* total shapes locked */
+	uint32_t cleared;	/* rows removed by the last lock, bit per row */
+
+	uint64_t seed;		/* initial seed, for replays */
+	uint32_t rng[4];	/* xoshiro128** state */
+	uint8_t  bag[7];	/* shapes left in the 7-bag */
+	int      bag_len;
+
+	int   over;		/* game over or won, only reset accepted */
+};
+
+/*
+ * Everything about a game that changes as it is played, packed to fit
+ * in less than two cache lines: the rows of the bitboard down to the
+ * floor, the queue and the counters, the small ones in one word.
+ * Trivially copyable, tetris_save() and tetris_load() move it in and
+ * out of a game of the same size and flags.  Lines and shapes are kept
+ * to 32 bits.
+ */
+struct tetris_state {
+	uint16_t rows[B_MAX_HEIGHT + 1];	/* rows 0..height, walls included */
+	uint8_t  queue[TETRIS_QUEUE];
+	uint8_t  head, queued;		/* head modulo TETRIS_QUEUE */
+	uint8_t  shape;
+	int8_t   hold;
+	uint32_t bits;			/* fall, rest, resets, held, over, bag_len, lines_cleared */
+	uint16_t pos;
+	uint16_t level;
+	uint8_t  bag[7];
+	uint32_t rng[4];
+	uint32_t lines, pieces;
+	int64_t  points;
+};
+
+/*
+ * Undo history, the state at the spawn of each of the last TETRIS_UNDO
+ * shapes, in a ring.  With it the colors of the stack, three bit planes
+ * by row, shape colors 1-7 as they are and 0 for grey, so an undo puts
+ * back the board as the player saw it.  Cheap enough for every shape.
+ */
+#define TETRIS_UNDO      32	/* ring size, power of two */
+
+struct tetris_history {
+	struct tetris_state state[TETRIS_UNDO];
+	uint16_t color[TETRIS_UNDO][3][B_MAX_HEIGHT + 1];
+	unsigned top, len;
+};
+
+void tetris_init  (struct tetris_game *game, uint64_t seed, int flags);
+int  tetris_init_size (struct tetris_game *game, uint64_t seed, int flags, int width, int height);
+void tetris_reset (struct tetris_game *game);
+int  tetris_step  (struct tetris_game *game, int input);
+int  tetris_fits  (const struct tetris_game *game, int shape, int pos);
+int  tetris_gravity (int level);
+int  tetris_idle  (const struct tetris_game *game);
+int  tetris_add_garbage (struct tetris_game *game, int lines, int hole);
+
+/* A final position of a shape, see tetris_placements() */
+struct tetris_placement {
+	uint8_t  shape;		/* rotation, index in the shape table */
+	uint16_t pos;		/* board index of its center */
+};
+
+#define TETRIS_PLACEMENTS (4 * B_MAX_WIDTH)	/* at most, of one shape */
+
+int  tetris_landing (const struct tetris_game *game, int shape, int pos);
+int  tetris_placements (const struct tetris_game *game, int shape,
+			struct tetris_placement out[TETRIS_PLACEMENTS]);
+
+void tetris_save  (const struct tetris_game *game, struct tetris_state *st);
+void tetris_load  (struct tetris_game *game, const struct tetris_state *st);
+void tetris_push  (struct tetris_history *h, const struct tetris_game *game);
+int  tetris_undo  (struct tetris_history *h, struct tetris_game *game);
+
+#endif /* TETRIS_ENGINE_H_ */
@@ -0,0 +1,633 @@
+/* Micro Tetris, fuzz and property tests of the engine
+ *
+ * Copyright (c) 2025  julmajustus <julmajustus@tutanota.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Every game is played twice in lockstep, on the legacy board[] and on
+ * the bitboard, and each step has to give the same events, shape, and
+ * position.  Next to them runs a copy of the original code, its shapes[]
+ * table, fits_in(), rotation and row by row clear, on a board of its
+ * own: each move, rotation and drop has to end where the original puts
+ * the shape, and each lock has to leave the board as the original clear
+ * does.  At every lock the boards are compared cell by cell, and the
+ * invariants are checked:
+ *
+ *  - the shape table is the original one, and each prev undoes next
+ *  - the border, 60, is where it was, and nothing else is 60 except
+ *    rows of garbage
+ *  - the bitboard, row fill and column heights match board[]
+ *  - both collision tests agree for the falling shape, anywhere
+ *  - landing rows and placements match stepping the shape down
+ *  - a snapshot loads back to the same state
+ *  - after a push to the undo history, an undo goes back to what the
+ *    game was at the push before, snapshot and colors of board[]
+ *
+ * Points, lines and shapes never go down.  A failure prints what broke
+ * and aborts, for the fuzzer to keep the input.
+ *
+ * Built for libFuzzer with -DFUZZ_LIBFUZZER, else there is a main() that
+ * runs each file given, or stdin, as one input, e.g. for AFL, and with
+ * -n N plays N seeded games of random inputs instead.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "engine.h"
+
+#define FUZZ_STEPS 100000	/* per game, random inputs rarely last this long */
+
+/*
+ * The original shape table, as it was before the engine: next rotation,
+ * the three offsets and the color, five ints a shape.  Kept here as is,
+ * only the offsets follow the stride, so the engine's table can not
+ * drift from it unnoticed.
+ */
+static const int shapes[] = {
+	 7, TL, TC, MR, 2,	/* ""__   */
+	 8, TR, TC, ML, 3,	/* __""   */
+	 9, ML, MR, BC, 1,	/* "|"    */
+	 3, TL, TC, ML, 4,	/* square */
+	12, ML, BL, MR, 5,	/* |"""   */
+	15, ML, BR, MR, 6,	/* """|   */
+	18, ML, MR,  2, 7,	/* ---- sticks out */
+	 0, TC, ML, BL, 2,	/* /    */
+	 1, TC, MR, BR, 3,	/* \    */
+	10, TC, MR, BC, 1,	/* |-   */
+	11, TC, ML, MR, 1,	/* _|_  */
+	 2, TC, ML, BC, 1,	/* -|   */
+	13, TC, BC, BR, 5,	/* |_   */
+	14, TR, ML, MR, 5,	/* ___| */
+	 4, TL, TC, BC, 5,	/* "|   */
+	16, TR, TC, BC, 6,	/* |"   */
+	17, TL, MR, ML, 6,	/* |___ */
+	 5, TC, BC, BL, 6,	/* _| */
+	 6, TC, BC,  2 * B_COLS, 7, /* | sticks out */
+};
+
+struct pair {
+	struct tetris_game legacy, bb;
+	long points, lines, pieces;
+
+	/* Board of the original code, only it ever touches it */
+	int ref[B_SIZE];
+
+	/* Undo history of bb, pushed at every lock, and the last push */
+	struct tetris_history history;
+	struct tetris_state last;
+	int last_board[B_SIZE];
+};
+
+static void fail(const struct pair *p, const char *what)
+{
+	fprintf(stderr, "FAIL: %s, seed %llu, flags %d, %dx%d, shape %ld\n", what,
+		(unsigned long long)p->bb.seed, p->bb.flags, p->bb.width, p->bb.height,
+		p->bb.pieces);
+	abort();
+}
+
+/* The original fits_in() and place(), on the reference board */
+static int fits_in(const int *board, const int *s, int pos)
+{
+	if (board[pos] || board[pos + s[1]] || board[pos + s[2]] || board[pos + s[3]])
+		return 0;
+
+	return 1;
+}
+
+static void place_in(int *board, const int *s, int pos, int c)
+{
+	board[pos] = c;
+	board[pos + s[1]] = c;
+	board[pos + s[2]] = c;
+	board[pos + s[3]] = c;
+}
+
+/*
+ * The original row by row clear, rows 1..height, returns lines cleared.
+ * A full row 0 shifts down full again and again, the original never
+ * got out of that, here it is -1.
+ */
+static int clear_in(int *board, int width, int height)
+{
+	int clears = 0;
+	int i, x;
+
+	for (x = 1; x <= width && board[x]; x++)
+		;
+
+	for (i = 1; i <= height; ++i) {
+		int full = 1;
+
+		for (int x = 1; x <= width; ++x) {
+			if (!board[i * B_COLS + x]) {
+				full = 0;
+				break;
+			}
+		}
+		if (full) {
+			if (x > width)
+				return -1;
+			++clears;
+			/* clear row i */
+			for (int x = 1; x <= width; ++x)
+				board[i * B_COLS + x] = 0;
+
+			/* shift everything above row i down one */
+			for (int y = i; y > 0; --y) {
+				for (int x = 1; x <= width; ++x)
+					board[y * B_COLS + x] = board[(y-1) * B_COLS + x];
+			}
+			/* re-check this same row index next iteration */
+			--i;
+		}
+	}
+
+	return clears;
+}
+
+/*
+ * One input as the original played it, from the shape and position the
+ * engine had before the step.  Gravity timing, the lock delay, hold and
+ * garbage are new, so a tick is only held to falling a row or not at
+ * all, and garbage and hold take the engine's word for it.
+ */
+static void check_ref(struct pair *p, int input, int shape, int pos, int events, long points)
+{
+	const struct tetris_game *g = &p->bb;
+	const int *s = &shapes[5 * shape];
+	int *board = p->ref;
+	int i;
+
+	if (events & TETRIS_LOCKED) {
+		if (input != TETRIS_TICK || fits_in(board, s, pos + B_COLS))
+			fail(p, "shape locked where the original would not");
+		place_in(board, s, pos, s[4]);
+		i = clear_in(board, g->width, g->height);
+		if (i < 0) {
+			memcpy(board, g->board, sizeof(p->ref));
+			return;
+		}
+		if (!(events & TETRIS_WON) && g->lines - p->lines != i)
+			fail(p, "lines cleared differ from the original");
+		if (memcmp(board, g->board, sizeof(p->ref)))
+			fail(p, "board differs from the original clear");
+		return;
+	}
+
+	switch (input) {
+	case TETRIS_TICK:
+		if (g->pos != pos && (g->pos != pos + B_COLS || !fits_in(board, s, pos + B_COLS)))
+			fail(p, "shape fell where the original would not");
+		return;
+
+	case TETRIS_LEFT:
+		if (!fits_in(board, s, --pos))
+			++pos;
+		break;
+
+	case TETRIS_RIGHT:
+		if (!fits_in(board, s, ++pos))
+			--pos;
+		break;
+
+	case TETRIS_ROTATE:
+		for (i = 0; i < 19; i++) {
+			if (shapes[5 * i] == shape)
+				break;
+		}
+		if (fits_in(board, &shapes[5 * i], pos))
+			shape = i;
+		break;
+
+	case TETRIS_RROTATE:
+		if (fits_in(board, &shapes[5 * *s], pos))
+			shape = *s;
+		break;
+
+	case TETRIS_DROP:
+		for (; fits_in(board, s, pos + B_COLS); ++points)
+			pos += B_COLS;
+		if (g->points != points)
+			fail(p, "drop points differ from the original");
+		break;
+
+	default:
+		return;
+	}
+
+	if (g->shape != shape || g->pos != pos)
+		fail(p, "shape or position differs from the original");
+}
+
+/* One game on its own, checked against its own board[] */
+static void check_game(const struct pair *p, struct tetris_game *g)
+{
+	int x, y;
+
+	for (y = 0; y < B_ROWS; y++) {
+		unsigned int bits = 0, fill = 0;
+
+		for (x = 0; x < B_COLS; x++) {
+			const int c = g->board[y * B_COLS + x];
+			const int wall = !x || x > g->width || y > g->height;
+
+			if (wall && c != 60)
+				fail(p, "border overwritten");
+			if (!wall && c == 60 && g->row_fill[y] < g->width - 1)
+				fail(p, "border color inside the board");
+			if (!wall && c)
+				fill++;
+			if (c)
+				bits |= 1u << x;
+		}
+		if (g->rows[y] != bits)
+			fail(p, "bitboard differs from board[]");
+		if (y <= g->height && g->row_fill[y] != fill)
+			fail(p, "row fill differs from board[]");
+	}
+
+	for (x = 1; x <= g->width; x++) {
+		int height = 0;
+
+		for (y = 0; y <= g->height; y++) {
+			if (g->rows[y] & (1u << x)) {
+				height = g->height + 1 - y;
+				break;
+			}
+		}
+		if (g->col_height[x] != height)
+			fail(p, "column height differs from board[]");
+	}
+}
+
+/* Both collision tests, landing and placements, for the falling shape */
+static void check_shape(const struct pair *p, struct tetris_game *g)
+{
+	struct tetris_placement out[TETRIS_PLACEMENTS];
+	const unsigned int walls = ~((1u << (g->width + 1)) - 2);
+	const int flags = g->flags;
+	int pos, n, i, s;
+
+	for (pos = B_COLS; pos < (g->height + 1) * B_COLS; pos++) {
+		int legacy, bb;
+
+		g->flags = flags | TETRIS_LEGACY;
+		legacy = tetris_fits(g, g->shape, pos);
+		g->flags = flags & ~TETRIS_LEGACY;
+		bb = tetris_fits(g, g->shape, pos);
+		g->flags = flags;
+		if (legacy != bb)
+			fail(p, "fits_in() and the bitboard disagree");
+	}
+
+	if (g->over)
+		return;
+
+	pos = g->pos;
+	while (tetris_fits(g, g->shape, pos + B_COLS))
+		pos += B_COLS;
+	if (tetris_landing(g, g->shape, g->pos) != pos)
+		fail(p, "landing row differs from stepping");
+
+	n = tetris_placements(g, g->shape, out);
+	i = 0;
+	s = g->shape;
+	do {
+		const uint16_t *m = tetris_shapes[s].mask;
+		int x;
+
+		for (x = 1; x <= g->width; x++) {
+			pos = B_COLS + x;
+			if ((((m[0] | m[1] | m[2] | m[3]) << x >> 1) & walls) || !tetris_fits(g, s, pos))
+				continue;
+			while (tetris_fits(g, s, pos + B_COLS))
+				pos += B_COLS;
+			if (i >= n || out[i].shape != s || out[i].pos != pos)
+				fail(p, "placements differ from stepping");
+			i++;
+		}
+		s = tetris_shapes[s].next;
+	} while (s != g->shape);
+	if (i != n)
+		fail(p, "placements differ from stepping");
+}
+
+/* Snapshot round trip, on a copy */
+static void check_state(const struct pair *p, const struct tetris_game *g)
+{
+	static struct tetris_game copy;
+	struct tetris_state st, again;
+
+	tetris_save(g, &st);
+	copy = *g;
+	memset(copy.rows, 0, sizeof(copy.rows[0]) * (g->height + 1));
+	memset(copy.col_height, 0, sizeof(copy.col_height));
+	tetris_load(&copy, &st);
+	tetris_save(&copy, &again);
+	if (memcmp(&st, &again, sizeof(st)) || memcmp(copy.rows, g->rows, sizeof(g->rows)) ||
+	    memcmp(copy.row_fill, g->row_fill, sizeof(g->row_fill)) ||
+	    memcmp(copy.col_height, g->col_height, sizeof(g->col_height)))
+		fail(p, "snapshot does not load back");
+}
+
+/* Push, then undo on a copy, it has to be back at the last push */
+static void check_undo(struct pair *p)
+{
+	static struct tetris_history h;
+	static struct tetris_game copy;
+	struct tetris_state st;
+
+	tetris_push(&p->history, &p->bb);
+	h = p->history;
+	copy = p->bb;
+	if (tetris_undo(&h, &copy))
+		fail(p, "undo failed with history left");
+	tetris_save(&copy, &st);
+	if (memcmp(&st, &p->last, sizeof(st)) || memcmp(copy.board, p->last_board, sizeof(copy.board)))
+		fail(p, "undo does not go back to the last push");
+
+	tetris_save(&p->bb, &p->last);
+	memcpy(p->last_board, p->bb.board, sizeof(p->last_board));
+}
+
+static void check_pair(struct pair *p)
+{
+	const struct tetris_game *a = &p->legacy, *b = &p->bb;
+
+	if (memcmp(a->board, b->board, sizeof(a->board)))
+		fail(p, "legacy and bitboard boards differ");
+	check_game(p, &p->legacy);
+	check_game(p, &p->bb);
+	check_shape(p, &p->bb);
+	check_state(p, b);
+}
+
+/*
+ * The engine's table against the original, and its hand typed prev
+ * against next: rotating back has to undo rotating, for all shapes.
+ */
+static void check_shapes(const struct pair *p)
+{
+	int i, j;
+
+	for (i = 0; i < TETRIS_SHAPES; i++) {
+		const struct tetris_shape *t = &tetris_shapes[i];
+
+		if (t->next != shapes[5 * i] || t->color != shapes[5 * i + 4])
+			fail(p, "shape table differs from the original");
+		for (j = 0; j < 3; j++) {
+			if (t->off[j] != shapes[5 * i + 1 + j])
+				fail(p, "shape table differs from the original");
+		}
+		if (tetris_shapes[t->prev].next != i || tetris_shapes[t->next].prev != i)
+			fail(p, "prev of a shape is not the inverse of next");
+	}
+}
+
+static void start(struct pair *p, uint64_t seed, int flags, int width, int height)
+{
+	int i;
+
+	check_shapes(p);
+	tetris_init_size(&p->legacy, seed, flags | TETRIS_LEGACY, width, height);
+	tetris_init_size(&p->bb, seed, flags, width, height);
+
+	/* Grey border, like the original init() but for any size */
+	for (i = 0; i < B_SIZE; i++) {
+		const int x = i % B_COLS, y = i / B_COLS;
+
+		p->ref[i] = !x || x > width || y > height ? 60 : 0;
+	}
+	if (memcmp(p->ref, p->bb.board, sizeof(p->ref)))
+		fail(p, "new board differs from the original");
+	p->points = p->lines = p->pieces = 0;
+	p->history.len = 0;
+	tetris_push(&p->history, &p->bb);
+	tetris_save(&p->bb, &p->last);
+	memcpy(p->last_board, p->bb.board, sizeof(p->last_board));
+	check_pair(p);
+}
+
+/* Low 3 bits a TETRIS_* input, 7 is garbage, lines and hole from the rest */
+static void step(struct pair *p, unsigned int code)
+{
+	struct tetris_game *a = &p->legacy, *b = &p->bb;
+	const int shape = b->shape, pos = b->pos;
+	const long points = b->points;
+	int ea, eb;
+
+	if ((code & 7) == 7) {
+		const int lines = 1 + (code >> 3 & 3), hole = 1 + (code >> 5) % b->width;
+
+		ea = tetris_add_garbage(a, lines, hole);
+		eb = tetris_add_garbage(b, lines, hole);
+	} else {
+		ea = tetris_step(a, code & 7);
+		eb = tetris_step(b, code & 7);
+	}
+
+	if (ea != eb || a->shape != b->shape || a->pos != b->pos || a->points != b->points ||
+	    a->over != b->over || a->fall != b->fall || a->rest != b->rest)
+		fail(p, "legacy and bitboard games differ");
+	if ((code & 7) == 7 || (code & 7) == TETRIS_HOLD)
+		memcpy(p->ref, b->board, sizeof(p->ref));
+	else
+		check_ref(p, code & 7, shape, pos, eb, points);
+	if (b->points < p->points || b->lines < p->lines || b->pieces < p->pieces)
+		fail(p, "points, lines or shapes went down");
+	p->points = b->points;
+	p->lines  = b->lines;
+	p->pieces = b->pieces;
+
+	if ((eb & TETRIS_LOCKED) || (code & 7) == 7 || b->over)
+		check_pair(p);
+	if ((eb & TETRIS_LOCKED) && !b->over)
+		check_undo(p);
+}
+
+/*
+ * One input: seed, flags and board size in the first 11 bytes, then one
+ * input a byte, see step().  Inputs too short for a header play the
+ * classic board.
+ */
+static void play(const uint8_t *data, size_t size)
+{
+	static struct pair p;
+	uint64_t seed = 0;
+	int flags = 0, width = B_WIDTH, height = B_HEIGHT;
+	size_t i;
+
+	if (size >= 11) {
+		for (i = 0; i < 8; i++)
+			seed |= (uint64_t)data[i] << (8 * i);
+		flags  = data[8] & TETRIS_BAG;
+		width  = B_MIN_WIDTH + data[9] % (B_MAX_WIDTH - B_MIN_WIDTH + 1);
+		height = B_MIN_HEIGHT + data[10] % (B_MAX_HEIGHT - B_MIN_HEIGHT + 1);
+		data += 11;
+		size -= 11;
+	}
+
+	start(&p, seed, flags, width, height);
+	for (i = 0; i < size && !p.bb.over; i++)
+		step(&p, data[i]);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	play(data, size);
+
+	return 0;
+}
+
+#ifndef FUZZ_LIBFUZZER
+static uint32_t xorshift(uint32_t *s)
+{
+	*s ^= *s << 13;
+	*s ^= *s >> 17;
+	*s ^= *s << 5;
+
+	return *s;
+}
+
+/* Inputs like a player's: mostly gravity, some moves, a drop now and then */
+static unsigned int random_input(uint32_t *s)
+{
+	static const uint8_t inputs[16] = {
+		TETRIS_LEFT, TETRIS_LEFT, TETRIS_RIGHT, TETRIS_RIGHT,
+		TETRIS_ROTATE, TETRIS_RROTATE, TETRIS_DROP, TETRIS_HOLD,
+		TETRIS_TICK, TETRIS_TICK, TETRIS_TICK, TETRIS_TICK,
+		TETRIS_TICK, TETRIS_TICK, TETRIS_TICK, 7
+	};
+	const uint32_t r = xorshift(s);
+	unsigned int code = inputs[r & 15];
+
+	if (code == 7 && (r >> 4 & 15))
+		code = TETRIS_TICK;	/* garbage is rare */
+
+	return code | (r >> 8 & ~7u);
+}
+
+/* Seeds first..first+games-1, on boards of every size, classic one first */
+static int property(long games, uint64_t first)
+{
+	static struct pair p;
+	struct timespec t0, t1;
+	long shapes = 0, steps = 0, n;
+	double sec;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (n = 0; n < games; n++) {
+		const uint64_t seed = first + n;
+		uint32_t s = (uint32_t)(seed * 2654435761u) | 1;
+		int width = B_WIDTH, height = B_HEIGHT, i;
+
+		if (n % 4) {
+			width  = B_MIN_WIDTH + xorshift(&s) % (B_MAX_WIDTH - B_MIN_WIDTH + 1);
+			height = B_MIN_HEIGHT + xorshift(&s) % (B_MAX_HEIGHT - B_MIN_HEIGHT + 1);
+		}
+
+		start(&p, seed, n & 1 ? TETRIS_BAG : 0, width, height);
+		for (i = 0; i < FUZZ_STEPS && !p.bb.over; i++)
+			step(&p, random_input(&s));
+		shapes += p.bb.pieces;
+		steps += i;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	sec = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+	printf("%ld games, seeds %llu-%llu, %ld shapes, %ld steps, %.2f s, %.0f games/s, all equal\n",
+	       games, (unsigned long long)first, (unsigned long long)(first + games - 1),
+	       shapes, steps, sec, games / sec);
+
+	return 0;
+}
+
+static int run_file(FILE *fp)
+{
+	static uint8_t buf[1 << 20];
+	size_t len = fread(buf, 1, sizeof(buf), fp);
+
+	play(buf, len);
+
+	return 0;
+}
+
+static int usage(int rc)
+{
+	printf("Usage: tetris-fuzz [-n GAMES] [-s SEED] [FILE...]\n"
+	       "\n"
+	       "  -n GAMES  Property test, legacy against bitboard engine and both\n"
+	       "            against the original code, over GAMES seeded games of\n"
+	       "            random inputs\n"
+	       "  -s SEED   First seed of the property test, default: 1\n"
+	       "\n"
+	       "Without -n, each FILE, or stdin, is played as one fuzz input.\n");
+
+	return rc;
+}
+
+int main(int argc, char *argv[])
+{
+	uint64_t seed = 1;
+	long games = 0;
+	int c, i;
+
+	while ((c = getopt(argc, argv, "hn:s:")) != EOF) {
+		switch (c) {
+		case 'n':
+			games = atol(optarg);
+			if (games < 1)
+				return usage(1);
+			break;
+
+		case 's':
+			seed = strtoull(optarg, NULL, 0);
+			break;
+
+		case 'h':
+			return usage(0);
+
+		default:
+			return usage(1);
+		}
+	}
+
+	if (games)
+		return property(games, seed);
+
+	if (optind == argc)
+		return run_file(stdin);
+
+	for (i = optind; i < argc; i++) {
+		FILE *fp = fopen(argv[i], "rb");
+
+		if (!fp) {
+			perror(argv[i]);
+			return 1;
+		}
+		run_file(fp);
+		fclose(fp);
+	}
+
+	return 0;
+}
+#endif /* FUZZ_LIBFUZZER */
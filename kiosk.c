@@ -0,0 +1,448 @@
+/* Micro Tetris, one game on each of several local ttys
+ *
+ * Copyright (c) 2025  julmajustus <julmajustus@tutanota.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "engine.h"
+#include "kiosk.h"
+#include "screen.h"
+#include "tty.h"
+
+#define TEXT_Y  11		/* status line, where the front end has its key help */
+#define TEXT_W  24
+
+/* Index in keys[], the same order as DEFAULT_KEYS of the front end */
+enum { K_LEFT, K_RROTATE, K_ROTATE, K_RIGHT, K_DROP, K_PAUSE, K_QUIT, K_RESTART,
+       K_HOLD, K_STATS, K_UNDO };
+
+enum { PLAYING, PAUSED, OVER };
+
+struct session {
+	struct tty            tty;		/* fd -1 when the seat has left */
+	struct screen         scr;
+	struct tetris_game    game;
+	struct tetris_history history;
+	int                   state;
+	int                   dirty;		/* changed since last drawn */
+	const char           *status;		/* text on the status line */
+	long                  ticks;		/* frames stepped, on the shared clock */
+	long                  due;		/* frame of the wheel slot it is in */
+	struct session       *next, **pprev;	/* in the slot, pprev NULL if not */
+};
+
+/*
+ * The timer wheel, a slot for each of the next KIOSK_WHEEL frames of the
+ * shared clock, with the sessions that have gravity to run then.  One
+ * further off than that sits in the last slot and is put back when it
+ * comes up, waking up early does no harm, gravity steps to the clock.
+ */
+static struct session *wheel[KIOSK_WHEEL];
+static uint64_t        busy;		/* bit n set when slot n is not empty */
+static long            frame;		/* frames the wheel has run, up to now */
+static uint64_t        epoch;		/* ns, frame 0 of the shared clock */
+static const char     *keys;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Frames of the shared clock that are due by now */
+static long frame_now(void)
+{
+	return (long)((now_ns() - epoch) * TETRIS_HZ / 1000000000ULL);
+}
+
+static void wheel_link(struct session *s)
+{
+	const int slot = s->due % KIOSK_WHEEL;
+
+	s->next = wheel[slot];
+	if (s->next)
+		s->next->pprev = &s->next;
+	s->pprev = &wheel[slot];
+	wheel[slot] = s;
+	busy |= 1ULL << slot;
+}
+
+static void wheel_del(struct session *s)
+{
+	const int slot = s->due % KIOSK_WHEEL;
+
+	if (!s->pprev)
+		return;
+
+	*s->pprev = s->next;
+	if (s->next)
+		s->next->pprev = s->pprev;
+	s->pprev = NULL;
+	if (!wheel[slot])
+		busy &= ~(1ULL << slot);
+}
+
+/* (Re)schedule for the frame where gravity next does something */
+static void wheel_add(struct session *s)
+{
+	const int idle = tetris_idle(&s->game);
+
+	wheel_del(s);
+	s->due = s->ticks + (idle > 0 ? idle : 1);
+	if (s->due <= frame)
+		s->due = frame + 1;
+	if (s->due - frame >= KIOSK_WHEEL)
+		s->due = frame + KIOSK_WHEEL - 1;
+	wheel_link(s);
+}
+
+/* Msec until the first frame with something to do, -1 if there is none */
+static int wheel_timeout(void)
+{
+	const int base = (frame + 1) % KIOSK_WHEEL;
+	uint64_t rot, ns, now;
+	long next;
+
+	if (!busy)
+		return -1;
+
+	rot  = base ? busy >> base | busy << (KIOSK_WHEEL - base) : busy;
+	next = frame + 1 + __builtin_ctzll(rot);
+	ns   = epoch + ((uint64_t)next * 1000000000ULL + TETRIS_HZ - 1) / TETRIS_HZ;
+	now  = now_ns();
+	if (ns <= now)
+		return 0;
+
+	return (int)((ns - now + 999999) / 1000000);
+}
+
+static void status(struct session *s, const char *text)
+{
+	char line[TEXT_W + 1];
+
+	snprintf(line, sizeof(line), "%-*s", TEXT_W, text);
+	screen_text(&s->scr, SCREEN_HUD_X(&s->game), TEXT_Y, line);
+	s->status = text;
+	s->dirty = 1;
+}
+
+/* Everything again, on a tty that may have lost any part of it */
+static void repaint(struct session *s)
+{
+	screen_clear(&s->scr);
+	status(s, s->status);
+}
+
+static void over(struct session *s, const char *text)
+{
+	s->state = OVER;
+	wheel_del(s);
+	status(s, text);
+}
+
+static void step(struct session *s, int input)
+{
+	const int ev = tetris_step(&s->game, input);
+
+	if (ev & TETRIS_LOCKED)
+		tetris_push(&s->history, &s->game);
+	if (ev & TETRIS_WON)
+		over(s, "YOU HAVE WON, r - again");
+	else if (ev & TETRIS_OVER)
+		over(s, "GAME OVER, r - again");
+	s->dirty = 1;
+}
+
+static void gravity(struct session *s, long now)
+{
+	while (s->state == PLAYING && s->ticks < now) {
+		s->ticks++;
+		step(s, TETRIS_TICK);
+	}
+}
+
+/* Run the sessions of every frame up to now */
+static void wheel_run(long now)
+{
+	const long last = frame;
+	long f;
+
+	frame = now;
+	for (f = last + 1; f <= now && f <= last + KIOSK_WHEEL && busy; f++) {
+		const int slot = f % KIOSK_WHEEL;
+		struct session *s = wheel[slot], *next;
+
+		wheel[slot] = NULL;
+		busy &= ~(1ULL << slot);
+		for (; s; s = next) {
+			next = s->next;
+			s->pprev = NULL;
+			if (s->due > now) {
+				/* Put in this slot after it was run, it is for later */
+				wheel_link(s);
+				continue;
+			}
+
+			gravity(s, now);
+			if (s->state == PLAYING)
+				wheel_add(s);
+		}
+	}
+}
+
+/* A fresh game on the board, gravity from this frame on */
+static void start(struct session *s, long now)
+{
+	s->history.len = 0;
+	tetris_push(&s->history, &s->game);
+	s->state = PLAYING;
+	s->ticks = now;
+	s->status = "";
+	repaint(s);
+	wheel_add(s);
+}
+
+/* Give the tty back the way it was, the seat is empty from now on */
+static void leave(struct session *s)
+{
+	wheel_del(s);
+	screen_leave(&s->scr);
+	tty_restore(&s->tty);
+	close(s->tty.fd);
+	s->tty.fd = -1;
+}
+
+/* Map keys[] to engine input, -1 if not a game key */
+static int key_input(int c)
+{
+	static const int input[] = {
+		[K_LEFT]    = TETRIS_LEFT,
+		[K_RROTATE] = TETRIS_RROTATE,
+		[K_ROTATE]  = TETRIS_ROTATE,
+		[K_RIGHT]   = TETRIS_RIGHT,
+		[K_DROP]    = TETRIS_DROP,
+		[K_HOLD]    = TETRIS_HOLD,
+	};
+	size_t i;
+
+	for (i = 0; i < sizeof(input) / sizeof(input[0]); i++) {
+		if (input[i] && c == keys[i])
+			return input[i];
+	}
+
+	return -1;
+}
+
+static void key(struct session *s, int c, long now)
+{
+	int input;
+
+	if (c == keys[K_QUIT]) {
+		leave(s);
+		return;
+	}
+
+	switch (s->state) {
+	case PAUSED:
+		if (c == keys[K_PAUSE]) {
+			/* Continue from the frame we paused at */
+			s->state = PLAYING;
+			s->ticks = now;
+			status(s, "");
+		}
+		return;
+
+	case OVER:
+		if (c == keys[K_RESTART]) {
+			tetris_reset(&s->game);
+			start(s, now);
+		}
+		return;
+	}
+
+	if (c == keys[K_PAUSE]) {
+		s->state = PAUSED;
+		wheel_del(s);
+		status(s, "PAUSED, p - resume");
+	} else if (c == keys[K_RESTART]) {
+		tetris_reset(&s->game);
+		start(s, now);
+	} else if (c == keys[K_UNDO]) {
+		if (!tetris_undo(&s->history, &s->game))
+			s->dirty = 1;
+	} else if ((input = key_input(c)) != -1) {
+		step(s, input);
+	}
+}
+
+/*
+ * Keys pending on the tty.  Due gravity goes first, all keys of one
+ * read land on the same frame, and the board is drawn once after them.
+ */
+static void input(struct session *s, long now)
+{
+	char buf[64];
+	ssize_t num, i;
+
+	num = read(s->tty.fd, buf, sizeof(buf));
+	if (num <= 0) {
+		if (num < 0 && (errno == EINTR || errno == EAGAIN))
+			return;
+
+		/* EOF, or the tty hung up */
+		leave(s);
+		return;
+	}
+
+	gravity(s, now);
+	for (i = 0; i < num && s->tty.fd != -1; i++)
+		key(s, buf[i], now);
+	if (s->tty.fd != -1 && s->state == PLAYING)
+		wheel_add(s);
+}
+
+/*
+ * Open and take over a tty, with a new game for it.  Non-blocking, a tty
+ * that stops reading does not hold up the others, its frames are dropped
+ * and it is repainted once it can be written to again.
+ */
+static int seat(struct session *s, const char *path, uint64_t seed, int flags, int width,
+		int height, int previews, int profile)
+{
+	int fd;
+
+	fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+	if (tty_cbreak(&s->tty, fd)) {
+		tty_restore(&s->tty);
+		close(fd);
+		s->tty.fd = -1;
+		return -1;
+	}
+
+	tetris_init_size(&s->game, seed, flags, width, height);
+	screen_init(&s->scr, fd);
+	s->scr.profile = profile < 0 ? screen_detect() : profile;
+	s->scr.previews = previews;
+	screen_enter(&s->scr);
+
+	return 0;
+}
+
+/*
+ * A seat on each tty of the comma separated list, all with the same
+ * seed, and so the same shapes, like the two seats of a server match.
+ * The loop: draw what changed, poll all ttys with a timeout to the next
+ * busy frame of the wheel, run the wheel up to the clock, then the keys.
+ * Returns when every seat has left, or *running is cleared.
+ */
+int kiosk_run(char *ttys, const char *keymap, uint64_t seed, int flags, int width,
+	      int height, int previews, int profile, volatile sig_atomic_t *running)
+{
+	struct pollfd pfd[KIOSK_MAX];
+	struct session *sessions, *ready[KIOSK_MAX];
+	char *path;
+	int n = 0, i, rc = 0;
+
+	sessions = calloc(KIOSK_MAX, sizeof(*sessions));
+	if (!sessions) {
+		perror("kiosk");
+		return 1;
+	}
+	for (i = 0; i < KIOSK_MAX; i++)
+		sessions[i].tty.fd = -1;
+
+	keys = keymap;
+	for (path = strtok(ttys, ","); path; path = strtok(NULL, ",")) {
+		if (n == KIOSK_MAX) {
+			fprintf(stderr, "ERROR: more than %d ttys\n", KIOSK_MAX);
+			rc = 1;
+			break;
+		}
+		if (seat(&sessions[n], path, seed, flags, width, height, previews, profile)) {
+			perror(path);
+			rc = 1;
+			break;
+		}
+		n++;
+	}
+
+	epoch = now_ns();
+	frame = 0;
+	for (i = 0; !rc && i < n; i++)
+		start(&sessions[i], 0);
+
+	while (!rc && *running) {
+		int num = 0;
+		long now;
+
+		for (i = 0; i < n; i++) {
+			struct session *s = &sessions[i];
+
+			if (s->tty.fd == -1)
+				continue;
+
+			if (s->dirty && !s->scr.stalled) {
+				screen_update(&s->scr, &s->game);
+				s->dirty = 0;
+			}
+			pfd[num].fd = s->tty.fd;
+			pfd[num].events = POLLIN | (s->scr.stalled ? POLLOUT : 0);
+			pfd[num].revents = 0;
+			ready[num++] = s;
+		}
+		if (!num)
+			break;	/* all seats have left */
+
+		if (poll(pfd, num, wheel_timeout()) < 0 && errno != EINTR) {
+			perror("poll");
+			rc = 1;
+			break;
+		}
+
+		now = frame_now();
+		wheel_run(now);
+		for (i = 0; i < num; i++) {
+			struct session *s = ready[i];
+
+			if ((pfd[i].revents & POLLOUT) && s->scr.stalled) {
+				s->scr.stalled = 0;
+				repaint(s);
+			}
+			if (s->tty.fd != -1 && (pfd[i].revents & (POLLIN | POLLHUP | POLLERR | POLLNVAL)))
+				input(s, now);
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		if (sessions[i].tty.fd != -1)
+			leave(&sessions[i]);
+	}
+	free(sessions);
+
+	return rc;
+}
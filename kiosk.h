@@ -0,0 +1,36 @@
+/* Micro Tetris, one game on each of several local ttys
+ *
+ * Copyright (c) 2025  julmajustus <julmajustus@tutanota.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#ifndef TETRIS_KIOSK_H_
+#define TETRIS_KIOSK_H_
+
+#include <signal.h>
+#include <stdint.h>
+
+/*
+ * Split screen and kiosk farms: a game on each tty or pty given, all
+ * run from one poll() loop in one process.  Every tty has its own modes,
+ * frame buffer and game, gravity of all of them runs off one timer
+ * wheel of KIOSK_WHEEL frames, one bit each in a 64-bit mask, so the
+ * loop only wakes up for frames where some board has something to do.
+ */
+#define KIOSK_MAX    64		/* ttys at most */
+#define KIOSK_WHEEL  64		/* frames, slots of the timer wheel */
+
+int kiosk_run(char *ttys, const char *keys, uint64_t seed, int flags, int width,
+	      int height, int previews, int profile, volatile sig_atomic_t *running);
+
+#endif /* TETRIS_KIOSK_H_ */
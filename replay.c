@@ -0,0 +1,217 @@
+/* Micro Tetris, compact replay recording and playback
+ *
+ * Copyright (c) 2025  julmajustus <julmajustus@tutanota.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "replay.h"
+
+static void flush(struct replay *rp)
+{
+	unsigned char *ptr = rp->buf;
+
+	while (rp->len > 0) {
+		ssize_t num = write(rp->fd, ptr, rp->len);
+
+		if (num < 0) {
+			if (errno == EINTR)
+				continue;
+			break;		/* lost, like a full disk with stdio */
+		}
+		ptr += num;
+		rp->len -= num;
+	}
+	rp->len = 0;
+}
+
+static void put(struct replay *rp, int c)
+{
+	if (rp->len == REPLAY_BUFSIZ)
+		flush(rp);
+	rp->buf[rp->len++] = c;
+}
+
+/* Next byte of the file, -1 at the end */
+static int get(struct replay *rp)
+{
+	if (rp->pos == rp->len) {
+		ssize_t num;
+
+		do {
+			num = read(rp->fd, rp->buf, REPLAY_BUFSIZ);
+		} while (num < 0 && errno == EINTR);
+		if (num <= 0)
+			return -1;
+
+		rp->len = num;
+		rp->pos = 0;
+	}
+
+	return rp->buf[rp->pos++];
+}
+
+static void put_varint(struct replay *rp, uint32_t val)
+{
+	while (val >= 0x80) {
+		put(rp, (val & 0x7f) | 0x80);
+		val >>= 7;
+	}
+	put(rp, val);
+}
+
+static int get_varint(struct replay *rp, uint32_t *val)
+{
+	int shift = 0, c;
+
+	*val = 0;
+	do {
+		if ((c = get(rp)) == -1 || shift > 28)
+			return -1;
+		*val |= (uint32_t)(c & 0x7f) << shift;
+		shift += 7;
+	} while (c & 0x80);
+
+	return 0;
+}
+
+/* Start a new session at the end of file, for a game just initialized */
+int replay_create(struct replay *rp, const char *file, const struct tetris_game *game)
+{
+	int i;
+
+	memset(rp, 0, sizeof(*rp));
+	rp->fd = open(file, O_WRONLY | O_CREAT | O_APPEND, 0644);
+	if (rp->fd == -1)
+		return -1;
+
+	for (i = 0; i < 4; i++)
+		put(rp, REPLAY_MAGIC[i]);
+	put(rp, REPLAY_VERSION);
+	put(rp, game->flags);
+	for (i = 0; i < 8; i++)
+		put(rp, (game->seed >> (8 * i)) & 0xff);
+	put(rp, game->width);
+	put(rp, game->height);
+
+	return 0;
+}
+
+/* Gravity ticks are only counted, until the next key or reset */
+void replay_record(struct replay *rp, int input)
+{
+	if (rp->fd == -1)
+		return;
+
+	if (input == TETRIS_TICK) {
+		rp->ticks++;
+		return;
+	}
+
+	put_varint(rp, rp->ticks);
+	put(rp, input);
+	rp->ticks = 0;
+}
+
+void replay_close(struct replay *rp)
+{
+	if (rp->fd == -1)
+		return;
+
+	replay_record(rp, REPLAY_END);
+	flush(rp);
+	close(rp->fd);
+	rp->fd = -1;
+}
+
+int replay_open(struct replay *rp, const char *file)
+{
+	memset(rp, 0, sizeof(*rp));
+	rp->next = -1;
+	rp->fd = open(file, O_RDONLY);
+	if (rp->fd == -1)
+		return -1;
+
+	return 0;
+}
+
+static int read_header(struct replay *rp)
+{
+	unsigned char hdr[16];
+	size_t i;
+	int c;
+
+	if ((c = get(rp)) == -1)
+		return REPLAY_EOF;
+	hdr[0] = c;
+	for (i = 1; i < sizeof(hdr); i++) {
+		if ((c = get(rp)) == -1)
+			return REPLAY_ERROR;
+		hdr[i] = c;
+	}
+	if (memcmp(hdr, REPLAY_MAGIC, 4) || hdr[4] != REPLAY_VERSION)
+		return REPLAY_ERROR;
+
+	rp->flags = hdr[5];
+	rp->seed  = 0;
+	for (i = 0; i < 8; i++)
+		rp->seed |= (uint64_t)hdr[6 + i] << (8 * i);
+	rp->width  = hdr[14];
+	rp->height = hdr[15];
+	rp->in_session = 1;
+
+	return REPLAY_SESSION;
+}
+
+/*
+ * Next input to feed tetris_step(), with the gravity ticks expanded,
+ * or one of REPLAY_RESET, REPLAY_END, REPLAY_SESSION, REPLAY_EOF and
+ * REPLAY_ERROR.  A session cut short, e.g. by a crash, ends where the
+ * file does.
+ */
+int replay_read(struct replay *rp)
+{
+	uint32_t ticks;
+	int ev;
+
+	if (rp->pending) {
+		rp->pending--;
+		return TETRIS_TICK;
+	}
+
+	if (rp->next != -1) {
+		ev = rp->next;
+		rp->next = -1;
+		if (ev == REPLAY_END)
+			rp->in_session = 0;
+		return ev;
+	}
+
+	if (!rp->in_session)
+		return read_header(rp);
+
+	if (get_varint(rp, &ticks) || (ev = get(rp)) == -1) {
+		rp->in_session = 0;
+		return REPLAY_END;
+	}
+
+	rp->pending = ticks;
+	rp->next = ev;
+
+	return replay_read(rp);
+}
@@ -0,0 +1,69 @@
+/* Micro Tetris, compact replay recording and playback
+ *
+ * Copyright (c) 2025  julmajustus <julmajustus@tutanota.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#ifndef TETRIS_REPLAY_H_
+#define TETRIS_REPLAY_H_
+
+#include "engine.h"
+
+/*
+ * A replay file is a sequence of sessions, appended to by each run.  A
+ * session is a header, "TTRP", version, tetris_init() flags, the 64-bit
+ * seed in little endian, board width and height, followed by events.
+ * An event is the number of gravity ticks, frames of TETRIS_HZ, since
+ * the previous event, as a LEB128 varint, and one byte: a TETRIS_*
+ * input, REPLAY_RESET, REPLAY_UNDO or REPLAY_END.
+ */
+#define REPLAY_MAGIC      "TTRP"
+#define REPLAY_VERSION    1
+
+#define REPLAY_RESET      0x80	/* game restarted, tetris_reset() */
+#define REPLAY_UNDO       0x81	/* back one shape, tetris_undo() */
+#define REPLAY_END        0xff	/* end of session */
+
+/* Returned by replay_read() besides the TETRIS_* inputs */
+#define REPLAY_EOF        -1
+#define REPLAY_SESSION    -2	/* new session, rp->seed, flags and size set */
+#define REPLAY_ERROR      -3	/* not a replay, or truncated session */
+
+#define REPLAY_BUFSIZ     4096
+
+/* Buffered on the fd with read() and write(), there is no stdio here */
+struct replay {
+	int       fd;			/* -1 when not open */
+	unsigned char buf[REPLAY_BUFSIZ];
+	int       len, pos;		/* bytes in buf, next one to read */
+
+	/* Recording, ticks since the last recorded event */
+	uint32_t  ticks;
+
+	/* Playback */
+	uint64_t  seed;
+	int       flags;
+	int       width, height;
+	uint32_t  pending;		/* gravity ticks left before next */
+	int       next;			/* event after those, -1 for none */
+	int       in_session;
+};
+
+int  replay_create (struct replay *rp, const char *file, const struct tetris_game *game);
+void replay_record (struct replay *rp, int input);
+void replay_close  (struct replay *rp);
+
+int  replay_open   (struct replay *rp, const char *file);
+int  replay_read   (struct replay *rp);
+
+#endif /* TETRIS_REPLAY_H_ */
@@ -0,0 +1,391 @@
+/* Micro Tetris, high score table
+ *
+ * Copyright (c) 2009-2021  Joachim Wiberg <troglobit@gmail.com>
+ * Copyright (c) 2025  julmajustus <julmajustus@tutanota.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "score.h"
+
+#ifdef ENABLE_BINARY_SCORE
+#define SCORE_FILE "tetris.scores.bin"
+#else
+#define SCORE_FILE "tetris.scores"
+#endif
+
+struct entry {
+	long   score;
+	long   points;
+	int    level;
+	time_t time;		/* when it was played, 0 if not known */
+	char   name[32];
+};
+
+#ifdef ENABLE_HIGH_SCORE
+static char state_dir[PATH_MAX];
+static char high_score_file[PATH_MAX];
+#endif
+
+void init_high_score_file(void)
+{
+#ifdef ENABLE_HIGH_SCORE
+    const char *xdg = getenv("XDG_STATE_HOME");
+    const char *home = getenv("HOME");
+    const char *base;
+
+    if (xdg && *xdg) {
+        base = xdg;
+    } else if (home && *home) {
+        base = home;
+    } else {
+        fputs("ERROR: neither XDG_STATE_HOME nor HOME is set\n", stderr);
+        exit(1);
+    }
+
+    if (xdg && *xdg) {
+        if (snprintf(state_dir, sizeof state_dir, "%s/games", base) >= (int)sizeof state_dir) {
+            fputs("ERROR: state_dir path too long\n", stderr);
+            exit(1);
+        }
+    } else {
+        if (snprintf(state_dir, sizeof state_dir,
+                     "%s/.local/state/games", base) >= (int)sizeof state_dir) {
+            fputs("ERROR: state_dir path too long\n", stderr);
+            exit(1);
+        }
+    }
+
+    if (mkdir(state_dir, 0755) != 0 && errno != EEXIST) {
+        perror("mkdir(state_dir)");
+        exit(1);
+    }
+
+    if (snprintf(high_score_file, sizeof high_score_file,
+                 "%s/" SCORE_FILE, state_dir) >= (int)sizeof high_score_file) {
+        fputs("ERROR: high_score_file path too long\n", stderr);
+        exit(1);
+    }
+#endif /* ENABLE_HIGH_SCORE */
+}
+
+#ifdef ENABLE_HIGH_SCORE
+/*
+ * Insert in the table sorted by score, highest first.  Equal scores keep
+ * their order, so older entries win ties.  Returns new number of entries.
+ */
+static int insert(struct entry *tab, int num, const struct entry *e)
+{
+	int pos, i;
+
+	for (pos = 0; pos < num && tab[pos].score >= e->score; pos++)
+		;
+	if (pos >= HIGH_SCORES)
+		return num;
+
+	if (num < HIGH_SCORES)
+		num++;
+	for (i = num - 1; i > pos; i--)
+		tab[i] = tab[i - 1];
+	tab[pos] = *e;
+
+	return num;
+}
+
+#ifdef ENABLE_BINARY_SCORE
+/*
+ * Binary score file, in host byte order.  The first page holds a header
+ * and the sorted top table, so reading or updating it touches only that
+ * page.  Every game is also appended to the history after it, as fixed
+ * size records, for statistics.
+ */
+#define DB_MAGIC   "TTHS"
+#define DB_VERSION 1
+#define DB_PAGE    4096
+
+struct db_rec {
+	int64_t score;
+	int64_t points;
+	int64_t time;
+	int32_t level;
+	int32_t reserved;
+	char    name[32];
+};
+
+struct db_hdr {
+	char     magic[4];
+	uint32_t version;
+	uint32_t top;			/* entries in tab[] */
+	uint32_t reserved;
+	uint64_t count;			/* history records after this page */
+	struct db_rec tab[HIGH_SCORES];
+};
+
+_Static_assert(sizeof(struct db_rec) == 64, "fixed width records");
+_Static_assert(sizeof(struct db_hdr) <= DB_PAGE, "header must fit in one page");
+
+static int db_update(struct entry *tab, const struct entry *e)
+{
+	struct db_hdr *hdr;
+	struct db_rec rec = { 0 };
+	struct stat st;
+	int fd, num = 0, i;
+
+	fd = open(high_score_file, O_RDWR | O_CREAT | O_CLOEXEC, 0664);
+	if (fd == -1)
+		return 0;
+
+	/* Updated in place, so the file itself is locked */
+	flock(fd, LOCK_EX);
+	if (fstat(fd, &st))
+		goto done;
+	if (st.st_size > 0) {
+		char magic[sizeof(hdr->magic)];
+
+		/* Not ours, however short, leave it alone */
+		if (pread(fd, magic, sizeof(magic), 0) != sizeof(magic) ||
+		    memcmp(magic, DB_MAGIC, sizeof(magic)))
+			goto done;
+	}
+	if (st.st_size < DB_PAGE && ftruncate(fd, DB_PAGE))
+		goto done;
+
+	hdr = mmap(NULL, DB_PAGE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (hdr == MAP_FAILED)
+		goto done;
+
+	if (!st.st_size) {
+		memcpy(hdr->magic, DB_MAGIC, sizeof(hdr->magic));
+		hdr->version = DB_VERSION;
+	} else if (hdr->version != DB_VERSION) {
+		munmap(hdr, DB_PAGE);
+		goto done;
+	}
+
+	rec.score  = e->score;
+	rec.points = e->points;
+	rec.time   = e->time;
+	rec.level  = e->level;
+	snprintf(rec.name, sizeof(rec.name), "%s", e->name);
+	if (pwrite(fd, &rec, sizeof(rec), DB_PAGE + hdr->count * sizeof(rec)) == sizeof(rec))
+		hdr->count++;
+
+	if (hdr->top > HIGH_SCORES)
+		hdr->top = HIGH_SCORES;
+	for (i = 0; i < (int)hdr->top; i++) {
+		tab[i].score  = hdr->tab[i].score;
+		tab[i].points = hdr->tab[i].points;
+		tab[i].level  = hdr->tab[i].level;
+		tab[i].time   = hdr->tab[i].time;
+		snprintf(tab[i].name, sizeof(tab[i].name), "%s", hdr->tab[i].name);
+	}
+
+	num = insert(tab, hdr->top, e);
+	for (i = 0; i < num; i++) {
+		hdr->tab[i].score  = tab[i].score;
+		hdr->tab[i].points = tab[i].points;
+		hdr->tab[i].level  = tab[i].level;
+		hdr->tab[i].time   = tab[i].time;
+		snprintf(hdr->tab[i].name, sizeof(hdr->tab[i].name), "%s", tab[i].name);
+	}
+	hdr->top = num;
+
+	munmap(hdr, DB_PAGE);
+done:
+	close(fd);
+
+	return num;
+}
+#else
+/* Parse "score points level name" lines, skipping anything unreadable */
+static int parse(char *buf, struct entry *tab)
+{
+	char *line, *next;
+	int num = 0;
+
+	for (line = buf; *line; line = next) {
+		struct entry e;
+		char *ptr, *end;
+		size_t len;
+
+		next = strchr(line, '\n');
+		if (next)
+			*next++ = 0;
+		else
+			next = line + strlen(line);
+
+		e.score = strtol(line, &ptr, 10);
+		if (ptr == line)
+			continue;
+		e.points = strtol(ptr, &end, 10);
+		if (end == ptr)
+			continue;
+		e.level = (int)strtol(end, &ptr, 10);
+		if (ptr == end)
+			continue;
+		e.time = 0;	/* not in the text file */
+
+		ptr += strspn(ptr, " \t");
+		len = strlen(ptr);
+		if (len >= sizeof(e.name))
+			len = sizeof(e.name) - 1;
+		memcpy(e.name, ptr, len);
+		e.name[len] = 0;
+
+		num = insert(tab, num, &e);
+	}
+
+	return num;
+}
+
+/* The whole file in one read, returns number of entries */
+static int load(struct entry *tab, struct stat *st)
+{
+	char *buf;
+	ssize_t len = 0;
+	int fd, num = 0;
+
+	fd = open(high_score_file, O_RDONLY);
+	if (fd == -1)
+		return 0;
+
+	if (fstat(fd, st) || !(buf = malloc(st->st_size + 1))) {
+		close(fd);
+		return 0;
+	}
+
+	while (len < st->st_size) {
+		ssize_t n = read(fd, buf + len, st->st_size - len);
+
+		if (n <= 0) {
+			if (n < 0 && errno == EINTR)
+				continue;
+			break;
+		}
+		len += n;
+	}
+	buf[len] = 0;
+	close(fd);
+
+	num = parse(buf, tab);
+	free(buf);
+
+	return num;
+}
+
+/* Write to a temporary file next to it, then atomically replace it */
+static int save(const struct entry *tab, int num, const struct stat *st)
+{
+	char tmp[PATH_MAX + 8];
+	FILE *fp;
+	int fd, i;
+
+	if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", high_score_file) >= (int)sizeof(tmp))
+		return -1;
+
+	fd = mkstemp(tmp);
+	if (fd == -1)
+		return -1;
+	fchmod(fd, st->st_mode ? st->st_mode & 07777 : 0644);
+
+	fp = fdopen(fd, "w");
+	if (!fp) {
+		close(fd);
+		unlink(tmp);
+		return -1;
+	}
+
+	for (i = 0; i < num; i++)
+		fprintf(fp, "%7ld\t %5ld\t  %3d\t%s\n",
+			tab[i].score, tab[i].points, tab[i].level, tab[i].name);
+
+	if (fclose(fp) || rename(tmp, high_score_file)) {
+		unlink(tmp);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Text file, returns the table with e inserted */
+static int text_update(struct entry *tab, const struct entry *e)
+{
+	char lock[PATH_MAX + 8];
+	struct stat st = { 0 };
+	int fd = -1, num;
+
+	/* Serialize concurrent players, the lock file is never replaced */
+	if (snprintf(lock, sizeof(lock), "%s.lock", high_score_file) < (int)sizeof(lock)) {
+		fd = open(lock, O_RDWR | O_CREAT | O_CLOEXEC, 0664);
+		if (fd != -1)
+			flock(fd, LOCK_EX);
+	}
+
+	num = load(tab, &st);
+	num = insert(tab, num, e);
+	save(tab, num, &st);
+
+	if (fd != -1)
+		close(fd);
+
+	return num;
+}
+#endif /* ENABLE_BINARY_SCORE */
+#endif /* ENABLE_HIGH_SCORE */
+
+void show_high_score(long points, int level)
+{
+#ifdef ENABLE_HIGH_SCORE
+	struct entry tab[HIGH_SCORES], e;
+	char *name;
+	int num, i;
+
+	name = getenv("LOGNAME");
+	if (!name)
+		name = "anonymous";
+
+	e.score  = points * level;
+	e.points = points;
+	e.level  = level;
+	e.time   = time(NULL);
+	snprintf(e.name, sizeof(e.name), "%s", name);
+
+#ifdef ENABLE_BINARY_SCORE
+	num = db_update(tab, &e);
+#else
+	num = text_update(tab, &e);
+#endif
+
+	fprintf(stderr, "  Score\tPoints\tLevel\tName\n");
+	for (i = 0; i < num; i++)
+		printf("%7ld\t %5ld\t  %3d\t%s\n",
+		       tab[i].score, tab[i].points, tab[i].level, tab[i].name);
+	fflush(stdout);		/* the front end writes to the tty directly */
+#else
+	(void)points;
+	(void)level;
+#endif /* ENABLE_HIGH_SCORE */
+}
@@ -0,0 +1,520 @@
+/* Micro Tetris, ANSI escape sequence renderer
+ *
+ * Copyright (c) 1989  John Tromp <john.tromp@gmail.com>
+ * Copyright (c) 2009-2021  Joachim Wiberg <troglobit@gmail.com>
+ * Copyright (c) 2025  julmajustus <julmajustus@tutanota.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "screen.h"
+
+/* Synchronized update, the terminal paints a frame only once it is all in */
+#define SYNC_BEGIN "\033[?2026h"
+#define SYNC_END   "\033[?2026l"
+#define SYNC_LEN   8
+
+void screen_flush(struct screen *scr)
+{
+	char *ptr = scr->frame;
+
+	if (scr->sync && scr->len) {
+		memcpy(&scr->frame[scr->len], SYNC_END, SYNC_LEN);
+		scr->len += SYNC_LEN;
+	}
+
+	scr->bytes += scr->len;
+	if (scr->fd < 0) {
+		scr->len = 0;
+		return;		/* null sink, e.g. for benchmarks */
+	}
+
+	while (scr->len > 0) {
+		ssize_t num = write(scr->fd, ptr, scr->len);
+
+		if (num < 0) {
+			if (errno == EINTR)
+				continue;
+			scr->stalled = 1;
+			break;
+		}
+		ptr += num;
+		scr->len -= num;
+	}
+
+	scr->len = 0;
+}
+
+static void frame_put(struct screen *scr, const char *str, size_t len)
+{
+	if (scr->len + len + SYNC_LEN > sizeof(scr->frame))
+		screen_flush(scr);
+
+	if (scr->sync && !scr->len) {
+		memcpy(scr->frame, SYNC_BEGIN, SYNC_LEN);
+		scr->len = SYNC_LEN;
+	}
+
+	memcpy(&scr->frame[scr->len], str, len);
+	scr->len += len;
+}
+
+/* Decimal num at the end of buf, a string, no stdio needed */
+static char *num_str(char buf[24], long num)
+{
+	char *ptr = &buf[23];
+	unsigned long val = num < 0 ? -(unsigned long)num : (unsigned long)num;
+
+	*ptr = 0;
+	do {
+		*--ptr = '0' + val % 10;
+		val /= 10;
+	} while (val);
+	if (num < 0)
+		*--ptr = '-';
+
+	return ptr;
+}
+
+/* Returns the number of digits queued, for moving the cursor */
+static int frame_num(struct screen *scr, long num)
+{
+	char buf[24], *ptr = num_str(buf, num);
+
+	frame_put(scr, ptr, &buf[23] - ptr);
+
+	return &buf[23] - ptr;
+}
+
+static int digits(int num)
+{
+	int len = 1;
+
+	while (num >= 10) {
+		num /= 10;
+		len++;
+	}
+
+	return len;
+}
+
+/* CSI n final, the count is left out when it is 1, the default */
+static void frame_csi(struct screen *scr, int n, char final)
+{
+	frame_put(scr, "\033[", 2);
+	if (n != 1)
+		frame_num(scr, n);
+	frame_put(scr, &final, 1);
+}
+
+static int csi_len(int n)
+{
+	return 3 + (n != 1 ? digits(n) : 0);
+}
+
+/*
+ * Move the cursor the shortest way there, nothing if it already is.
+ * Relative moves, CUU/CUD and CUF/CUB or CR, when the position is known
+ * and they are shorter than the absolute CUP.  All of them are VT100.
+ */
+static void frame_goto(struct screen *scr, int x, int y)
+{
+	int cup, vert, horiz, cr;
+
+	if (x == scr->x && y == scr->y)
+		return;
+
+	cup = 3 + digits(y) + (x > 1 ? 1 + digits(x) : 0);
+	if (scr->x && scr->y) {
+		vert  = y == scr->y ? 0 : csi_len(abs(y - scr->y));
+		horiz = x == scr->x ? 0 : csi_len(abs(x - scr->x));
+		cr    = 1 + (x > 1 ? csi_len(x - 1) : 0);
+
+		if (vert + (horiz < cr ? horiz : cr) < cup) {
+			if (y != scr->y)
+				frame_csi(scr, abs(y - scr->y), y < scr->y ? 'A' : 'B');
+			if (horiz < cr) {
+				if (x != scr->x)
+					frame_csi(scr, abs(x - scr->x), x < scr->x ? 'D' : 'C');
+			} else {
+				frame_put(scr, "\r", 1);
+				if (x > 1)
+					frame_csi(scr, x - 1, 'C');
+			}
+			scr->x = x;
+			scr->y = y;
+			return;
+		}
+	}
+
+	frame_put(scr, "\033[", 2);
+	frame_num(scr, y);
+	if (x > 1) {
+		frame_put(scr, ";", 1);
+		frame_num(scr, x);
+	}
+	frame_put(scr, "H", 1);
+	scr->x = x;
+	scr->y = y;
+}
+
+/*
+ * Shape colors 1-7 and the border, 60, in the 256 color palette and as
+ * RGB, close to the usual colors of each shape.
+ */
+static const struct {
+	unsigned char c, xterm, r, g, b;
+} palette[] = {
+	{  1, 129, 160,   0, 240 },	/* T, purple */
+	{  2, 160, 240,   0,   0 },	/* Z, red */
+	{  3,  40,   0, 240,   0 },	/* S, green */
+	{  4, 220, 240, 240,   0 },	/* O, yellow */
+	{  5, 208, 240, 160,   0 },	/* L, orange */
+	{  6,  21,   0,   0, 240 },	/* J, blue */
+	{  7,  51,   0, 240, 240 },	/* I, cyan */
+	{ 60, 244, 128, 128, 128 },	/* border, grey */
+};
+
+/* Background color of what comes next, 0 is the default */
+static void frame_color(struct screen *scr, int c)
+{
+	size_t i;
+
+	if (c == scr->color || scr->profile == SCREEN_MONO)
+		return;
+
+	scr->color = c;
+	if (!c) {
+		frame_put(scr, "\033[m", 3);
+		return;
+	}
+
+	for (i = 0; scr->profile != SCREEN_ANSI16 && i < sizeof(palette) / sizeof(palette[0]); i++) {
+		if (palette[i].c != c)
+			continue;
+
+		if (scr->profile == SCREEN_256) {
+			frame_put(scr, "\033[48;5;", 7);
+			frame_num(scr, palette[i].xterm);
+		} else {
+			frame_put(scr, "\033[48;2;", 7);
+			frame_num(scr, palette[i].r);
+			frame_put(scr, ";", 1);
+			frame_num(scr, palette[i].g);
+			frame_put(scr, ";", 1);
+			frame_num(scr, palette[i].b);
+		}
+		frame_put(scr, "m", 1);
+		return;
+	}
+
+	frame_put(scr, "\033[", 2);
+	frame_num(scr, c + 40);
+	frame_put(scr, "m", 1);
+}
+
+/* Plain text, no newlines, at the current cursor position */
+static void frame_text(struct screen *scr, const char *str)
+{
+	size_t len = strlen(str);
+
+	frame_put(scr, str, len);
+	scr->x += len;
+}
+
+/* Pseudo color of the ghost shape, an outline on the default background */
+#define GHOST 61
+
+static void draw(struct screen *scr, int x, int y, int c)
+{
+	frame_goto(scr, x, y);
+	if (c == GHOST) {
+		frame_color(scr, 0);
+		frame_put(scr, "::", 2);
+	} else {
+		frame_color(scr, c);
+		frame_put(scr, scr->profile == SCREEN_MONO && c ? "[]" : "  ", 2);
+	}
+	scr->x += 2;
+}
+
+#ifdef ENABLE_SCORE
+/* Only the digits that differ from the last rendered value are resent */
+static void hud_field(struct screen *scr, int hud, int y, const char *label, long val, char *last)
+{
+	const int x = hud + strlen(label);
+	char tmp[24], *buf = num_str(tmp, val);
+	int i;
+
+	if (!last[0]) {
+		frame_goto(scr, hud, y);
+		frame_color(scr, 0);
+		frame_text(scr, label);
+	} else if (!strcmp(buf, last)) {
+		return;
+	}
+
+	for (i = 0; buf[i] && buf[i] == last[i]; i++)
+		;
+
+	frame_goto(scr, x + i, y);
+	frame_color(scr, 0);
+	frame_text(scr, &buf[i]);
+	if (strlen(last) > strlen(buf))
+		frame_put(scr, "\033[K", 3);	/* shorter than before, erase the tail */
+
+	strcpy(last, buf);
+}
+#endif
+
+/* Forget what is on screen, call after clearing it or writing behind our back */
+void screen_invalidate(struct screen *scr)
+{
+	int i;
+
+	memset(scr->shadow, 0, sizeof(scr->shadow));
+	for (i = 0; i < SCREEN_SLOTS; i++)
+		scr->slot[i] = -1;
+	scr->x = scr->y = 0;
+	scr->color = -1;
+	scr->hud_level[0] = scr->hud_points[0] = 0;
+	scr->hud_labels = 0;
+}
+
+void screen_init(struct screen *scr, int fd)
+{
+	scr->fd = fd;
+	scr->len = 0;
+	scr->bytes = 0;
+	scr->profile = SCREEN_ANSI16;
+	scr->sync = scr->alt = scr->stalled = 0;
+	scr->previews = 1;
+	screen_invalidate(scr);
+}
+
+/* Take over the tty: alternate screen, unless mono, and no cursor */
+void screen_enter(struct screen *scr)
+{
+	if (scr->profile != SCREEN_MONO) {
+		frame_put(scr, "\033[?1049h", 8);
+		scr->alt = 1;
+	}
+	frame_put(scr, "\033[?25l", 6);
+	screen_flush(scr);
+	screen_invalidate(scr);
+}
+
+/* Give it back the way it was */
+void screen_leave(struct screen *scr)
+{
+	frame_put(scr, "\033[m\033[?25h", 9);
+	if (scr->alt) {
+		frame_put(scr, "\033[?1049l", 8);
+		scr->alt = 0;
+	}
+	screen_flush(scr);
+}
+
+/* Profile by name, ansi16, 256, truecolor or mono, -1 if unknown */
+int screen_profile(const char *name)
+{
+	static const char *names[] = { "ansi16", "256", "truecolor", "mono" };
+	int i;
+
+	for (i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++) {
+		if (!strcmp(name, names[i]))
+			return i;
+	}
+
+	return -1;
+}
+
+/*
+ * Best profile for the terminal, from COLORTERM and TERM.  Terminals
+ * known to have no color, e.g. a VT100 on a serial line, get mono.
+ */
+int screen_detect(void)
+{
+	static const char *mono[] = { "dumb", "vt52", "vt100", "vt102", "vt220", "vt320" };
+	const char *term = getenv("TERM");
+	const char *colorterm = getenv("COLORTERM");
+	size_t i;
+
+	if (colorterm && (!strcmp(colorterm, "truecolor") || !strcmp(colorterm, "24bit")))
+		return SCREEN_TRUECOLOR;
+	if (!term)
+		return SCREEN_ANSI16;
+	if (strstr(term, "256color"))
+		return SCREEN_256;
+	for (i = 0; i < sizeof(mono) / sizeof(mono[0]); i++) {
+		if (!strcmp(term, mono[i]))
+			return SCREEN_MONO;
+	}
+
+	return SCREEN_ANSI16;
+}
+
+/*
+ * Clear the screen, everything is known to be blank after that.  Only
+ * queued, so the next screen_update() paints all of it as one frame.
+ */
+void screen_clear(struct screen *scr)
+{
+	screen_invalidate(scr);
+	frame_put(scr, "\033[m\033[H\033[2J", 10);
+	scr->x = scr->y = 1;
+	scr->color = 0;
+}
+
+/* Plain text at x, y, in the default color */
+void screen_text(struct screen *scr, int x, int y, const char *str)
+{
+	frame_goto(scr, x, y);
+	frame_color(scr, 0);
+	frame_text(scr, str);
+}
+
+/*
+ * Optional animation step for a line clear: blank the removed rows, as
+ * one frame, before screen_update() draws the compacted board.
+ */
+void screen_clear_rows(struct screen *scr, const struct tetris_game *game)
+{
+	int x, y;
+
+	for (y = 1; y <= game->height; y++) {
+		if (!(game->cleared & (1u << y)))
+			continue;
+
+		for (x = 1; x <= game->width; x++) {
+			if (scr->shadow[y * B_COLS + x]) {
+				scr->shadow[y * B_COLS + x] = 0;
+				draw(scr, x * 2 + SCREEN_BOARD_X, y, 0);
+			}
+		}
+	}
+
+	screen_flush(scr);
+}
+
+/* Cells of a shape in a 4x4 box, bit 4 * (dy + 1) + dx + 1 */
+static unsigned int slot_cells(int shape)
+{
+	const uint16_t *m;
+
+	if (shape < 0)
+		return 0;
+	m = tetris_shapes[shape].mask;
+
+	return m[0] | m[1] << 4 | m[2] << 8 | m[3] << 12;
+}
+
+/*
+ * Show shape in slot n, -1 for none.  A slot that still shows the same
+ * shape costs nothing, otherwise only cells that change are sent.
+ */
+static void slot_update(struct screen *scr, const struct tetris_game *game, int n, int shape)
+{
+	unsigned int old = slot_cells(scr->slot[n]), cells = slot_cells(shape);
+	int x0, y0, i;
+
+	if (scr->slot[n] == shape)
+		return;
+	scr->slot[n] = shape;
+
+	if (n == 1) {
+		x0 = SCREEN_HUD_X(game);
+		y0 = 6;
+	} else {
+		x0 = SCREEN_SLOT_X;
+		y0 = n ? 9 + 3 * (n - 2) : 3;
+	}
+
+	for (i = 0; i < 16; i++) {
+		if (cells & (1u << i))
+			draw(scr, x0 + i % 4 * 2, y0 + i / 4, tetris_shapes[shape].color);
+		else if (old & (1u << i))
+			draw(scr, x0 + i % 4 * 2, y0 + i / 4, 0);
+	}
+}
+
+/* Draw the difference between game and what is on screen, as one frame */
+void screen_update(struct screen *scr, const struct tetris_game *game)
+{
+	const int *board = game->board;
+	const signed char *s = tetris_shapes[game->shape].off;
+	const int hud = SCREEN_HUD_X(game);
+#ifdef ENABLE_GHOST
+	/* Where the falling shape would land, outlined below it */
+	const int ghost = game->over ? -1 : tetris_landing(game, game->shape, game->pos);
+#endif
+	int x, y;
+
+	slot_update(scr, game, 0, game->hold);
+#ifdef ENABLE_PREVIEW
+	for (x = 0; x < scr->previews; x++)
+		slot_update(scr, game, 1 + x, TETRIS_PEEK(game, x));
+#endif
+
+	/* Display board, with the falling shape on top */
+	for (y = 1; y <= game->height + 1; y++) {
+		for (x = 0; x <= game->width + 1; x++) {
+			int i = y * B_COLS + x;
+			int c = board[i]; /* color */
+
+			if (!game->over && (i == game->pos || i == game->pos + s[0] ||
+					    i == game->pos + s[1] || i == game->pos + s[2]))
+				c = game->color;
+#ifdef ENABLE_GHOST
+			else if (!c && (i == ghost || i == ghost + s[0] ||
+					i == ghost + s[1] || i == ghost + s[2]))
+				c = GHOST;
+#endif
+
+			if (c - scr->shadow[i]) {
+				scr->shadow[i] = c;
+				draw(scr, x * 2 + SCREEN_BOARD_X, y, c);
+			}
+		}
+	}
+
+#ifdef ENABLE_SCORE
+	/* Display current level and points */
+	hud_field(scr, hud, 2, "Level  : ", game->level, scr->hud_level);
+	hud_field(scr, hud, 3, "Points : ", game->points, scr->hud_points);
+#endif
+	if (!scr->hud_labels) {
+		frame_goto(scr, SCREEN_SLOT_X, 2);
+		frame_color(scr, 0);
+		frame_text(scr, "Hold:");
+#ifdef ENABLE_PREVIEW
+		frame_goto(scr, hud, 5);
+		frame_text(scr, "Preview:");
+		if (scr->previews > 1) {
+			frame_goto(scr, SCREEN_SLOT_X, 8);
+			frame_text(scr, "Next:");
+		}
+#endif
+		frame_goto(scr, hud, 10);
+		frame_color(scr, 0);
+		frame_text(scr, "Keys:");
+		scr->hud_labels = 1;
+	}
+
+	screen_flush(scr);
+}
@@ -0,0 +1,83 @@
+/* Micro Tetris, ANSI escape sequence renderer
+ *
+ * Copyright (c) 1989  John Tromp <john.tromp@gmail.com>
+ * Copyright (c) 2009-2021  Joachim Wiberg <troglobit@gmail.com>
+ * Copyright (c) 2025  julmajustus <julmajustus@tutanota.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#ifndef TETRIS_SCREEN_H_
+#define TETRIS_SCREEN_H_
+
+#include <stddef.h>
+#include "engine.h"
+
+#define FRAME_SIZE 8192
+
+/*
+ * tty columns, the board from SCREEN_BOARD_X and the HUD right of it.
+ * The first queue slot is in the HUD, the hold slot and the rest of the
+ * queue go left of the board.
+ */
+#define SCREEN_BOARD_X  28
+#define SCREEN_HUD_X(g) (SCREEN_BOARD_X + 2 * ((g)->width + 2) + 2)
+#define SCREEN_SLOT_X   (SCREEN_BOARD_X - 12)
+#define SCREEN_SLOTS    (1 + TETRIS_PREVIEWS)	/* hold, then the queue */
+
+/* Output profiles, see screen_detect() */
+#define SCREEN_ANSI16     0	/* SGR 40-47 and 100, the default */
+#define SCREEN_256        1	/* xterm 256 color palette */
+#define SCREEN_TRUECOLOR  2	/* 24-bit RGB */
+#define SCREEN_MONO       3	/* no SGR at all, shapes drawn as [], fewest bytes */
+
+/*
+ * Frame composer.  Everything screen_update() draws is collected in one
+ * buffer and sent with a single write(), tracking the cursor position
+ * and the active SGR code to skip escape sequences that change nothing.
+ */
+struct screen {
+	int    fd;			/* where frames are written, -1 discards */
+	unsigned long bytes;		/* total sent, for statistics */
+
+	char   frame[FRAME_SIZE];
+	size_t len;
+	int    x, y;			/* cursor position, 0 when unknown */
+	int    color;			/* active background color, -1 when unknown */
+	int    profile;			/* SCREEN_*, how cells and moves are sent */
+	int    sync;			/* frames in DEC mode 2026 brackets */
+	int    alt;			/* on the alternate screen */
+	int    stalled;			/* a write failed, the tty lost part of a frame */
+
+	int    shadow[B_SIZE];		/* what is on screen right now */
+	int    slot[SCREEN_SLOTS];	/* shape in each slot, -1 when blank */
+	int    previews;		/* queue slots shown, 1..TETRIS_PREVIEWS */
+
+	/* HUD cache, empty string when not on screen */
+	char   hud_level[24];
+	char   hud_points[24];
+	int    hud_labels;
+};
+
+void screen_init       (struct screen *scr, int fd);
+int  screen_detect     (void);
+int  screen_profile    (const char *name);
+void screen_enter      (struct screen *scr);
+void screen_leave      (struct screen *scr);
+void screen_clear      (struct screen *scr);
+void screen_text       (struct screen *scr, int x, int y, const char *str);
+void screen_invalidate (struct screen *scr);
+void screen_update     (struct screen *scr, const struct tetris_game *game);
+void screen_clear_rows (struct screen *scr, const struct tetris_game *game);
+void screen_flush      (struct screen *scr);
+
+#endif /* TETRIS_SCREEN_H_ */
@@ -0,0 +1,730 @@
+/* Micro Tetris, tournament server, many games over one epoll loop
+ *
+ * Copyright (c) 2025  julmajustus <julmajustus@tutanota.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define _GNU_SOURCE		/* accept4() */
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "engine.h"
+#include "server.h"
+
+#define MAX_EVENTS  256
+#define MSG_MAX     (4 + 3 * B_SIZE + 256)	/* a full diff, plus status and events */
+#define OUT_MAX     (64 * 1024)	/* backlog of a slow client, before it is dropped */
+
+struct client;
+
+struct seat {
+	struct tetris_game game;
+	struct client     *player;
+	uint8_t            shadow[B_SIZE];	/* board as last broadcast */
+	long               points;		/* status as last broadcast */
+	long               lines;
+	int                level;
+	uint64_t           epoch;		/* ns, gravity frames counted from */
+	uint64_t           ticks;		/* frames stepped */
+	unsigned char      msg[MSG_MAX];	/* messages of this frame */
+	size_t             len;
+};
+
+enum { WAITING, PLAYING, DONE };
+
+struct match {
+	unsigned           id;
+	int                state;
+	struct seat        seat[2];
+	struct client     *watchers;
+	int                clients;		/* players and watchers attached */
+	struct match      *next;		/* newest first */
+};
+
+struct client {
+	int                fd;
+	struct match      *match;		/* NULL until hello is done */
+	int                seat;		/* 0 or 1, -1 watching */
+	struct client     *prev, *next;	/* watchers of the same match */
+	unsigned char      hello[3];
+	int                hello_len;
+	unsigned char     *out;		/* backlog, when the socket is full */
+	size_t             out_len;
+	int                dead;
+	struct client     *reap;		/* dead ones, freed after the loop */
+};
+
+static int epfd = -1;
+static struct match  *matches;
+static unsigned       match_id;
+static struct client *dead;
+static uint32_t       hole_rng = 2463534242u;
+
+/* epoll tags of the two fds that are not clients */
+static char listen_tag, timer_tag;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned char *put16(unsigned char *p, unsigned val)
+{
+	*p++ = val & 0xff;
+	*p++ = (val >> 8) & 0xff;
+
+	return p;
+}
+
+static unsigned char *put32(unsigned char *p, uint32_t val)
+{
+	p = put16(p, val & 0xffff);
+
+	return put16(p, val >> 16);
+}
+
+static unsigned char *put64(unsigned char *p, uint64_t val)
+{
+	p = put32(p, val & 0xffffffff);
+
+	return put32(p, val >> 32);
+}
+
+/* Queue a message for the next frame, dropped if the frame is full */
+static void msg_put(struct seat *s, int type, int seat, const void *data, size_t len)
+{
+	unsigned char *p = &s->msg[s->len];
+
+	if (s->len + 4 + len > sizeof(s->msg))
+		return;
+
+	*p++ = type;
+	*p++ = seat;
+	p = put16(p, len);
+	if (len)
+		memcpy(p, data, len);
+	s->len += 4 + len;
+}
+
+static void client_kill(struct client *c)
+{
+	if (c->dead)
+		return;
+
+	c->dead = 1;
+	c->reap = dead;
+	dead = c;
+}
+
+/* Append to the backlog, and wait for the socket to drain */
+static int backlog(struct client *c, const void *data, size_t len)
+{
+	struct epoll_event ev = { .events = EPOLLIN | EPOLLOUT, .data.ptr = c };
+
+	if (!len)
+		return 0;
+
+	if (c->out_len + len > OUT_MAX) {
+		client_kill(c);		/* too slow to keep up */
+		return -1;
+	}
+	if (!c->out) {
+		c->out = malloc(OUT_MAX);
+		if (!c->out) {
+			client_kill(c);
+			return -1;
+		}
+	}
+
+	if (!c->out_len)
+		epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev);
+	memcpy(&c->out[c->out_len], data, len);
+	c->out_len += len;
+
+	return 0;
+}
+
+/* Everything for this client in one writev(), the rest to the backlog */
+static void client_send(struct client *c, const struct iovec *iov, int cnt)
+{
+	ssize_t num = 0;
+	int i;
+
+	if (c->dead)
+		return;
+
+	if (!c->out_len) {
+		num = writev(c->fd, iov, cnt);
+		if (num < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+				client_kill(c);
+				return;
+			}
+			num = 0;
+		}
+	}
+
+	for (i = 0; i < cnt; i++) {
+		size_t skip = (size_t)num < iov[i].iov_len ? (size_t)num : iov[i].iov_len;
+
+		num -= skip;
+		if (backlog(c, (const char *)iov[i].iov_base + skip, iov[i].iov_len - skip))
+			return;
+	}
+}
+
+static void client_flush(struct client *c)
+{
+	struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+	ssize_t num;
+
+	num = write(c->fd, c->out, c->out_len);
+	if (num < 0) {
+		if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			client_kill(c);
+		return;
+	}
+
+	c->out_len -= num;
+	memmove(c->out, &c->out[num], c->out_len);
+	if (!c->out_len)
+		epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+/* Board with the falling shape on top, like screen_update() shows it */
+static void view(const struct tetris_game *g, uint8_t *v)
+{
+	const signed char *s = tetris_shapes[g->shape].off;
+	int i;
+
+	for (i = 0; i < B_SIZE; i++)
+		v[i] = g->board[i];
+
+	if (!g->over)
+		v[g->pos] = v[g->pos + s[0]] = v[g->pos + s[1]] = v[g->pos + s[2]] = g->color;
+}
+
+static void status(struct seat *s, int seat)
+{
+	unsigned char buf[16], *p = buf;
+
+	p = put64(p, s->points);
+	p = put32(p, s->level);
+	p = put32(p, s->lines);
+	msg_put(s, MSG_STATUS, seat, buf, p - buf);
+}
+
+/* What changed since the last frame, the shadow is what clients have */
+static void seat_frame(struct match *m, int n)
+{
+	struct seat *s = &m->seat[n];
+	const struct tetris_game *g = &s->game;
+	unsigned char buf[3 * B_SIZE], *p = buf;
+	uint8_t v[B_SIZE];
+	int i;
+
+	view(g, v);
+	for (i = B_COLS; i < B_SIZE - B_COLS; i++) {
+		if (v[i] == s->shadow[i])
+			continue;
+
+		s->shadow[i] = v[i];
+		p = put16(p, i);
+		*p++ = v[i];
+	}
+	if (p > buf)
+		msg_put(s, MSG_DIFF, n, buf, p - buf);
+
+	if (g->points != s->points || g->level != s->level || g->lines != s->lines) {
+		s->points = g->points;
+		s->level  = g->level;
+		s->lines  = g->lines;
+		status(s, n);
+	}
+}
+
+static void broadcast(struct match *m)
+{
+	struct iovec iov[2];
+	struct client *c, *next;
+	int cnt = 0, n;
+
+	for (n = 0; n < 2; n++) {
+		if (!m->seat[n].len)
+			continue;
+		iov[cnt].iov_base = m->seat[n].msg;
+		iov[cnt].iov_len  = m->seat[n].len;
+		cnt++;
+	}
+	if (!cnt)
+		return;
+
+	for (n = 0; n < 2; n++) {
+		if (m->seat[n].player)
+			client_send(m->seat[n].player, iov, cnt);
+	}
+	for (c = m->watchers; c; c = next) {
+		next = c->next;
+		client_send(c, iov, cnt);
+	}
+
+	m->seat[0].len = m->seat[1].len = 0;
+}
+
+static void over(struct match *m, int n)
+{
+	if (m->state != PLAYING)
+		return;
+
+	m->seat[n].game.over = 1;
+	msg_put(&m->seat[n], MSG_OVER, n, NULL, 0);
+	m->state = DONE;
+}
+
+static void garbage(struct match *m, int n, int lines)
+{
+	struct seat *s = &m->seat[n];
+	unsigned char buf[2];
+	int hole;
+
+	hole_rng ^= hole_rng << 13;
+	hole_rng ^= hole_rng >> 17;
+	hole_rng ^= hole_rng << 5;
+	hole = 1 + hole_rng % s->game.width;
+
+	buf[0] = lines;
+	buf[1] = hole;
+	msg_put(s, MSG_GARBAGE, n, buf, sizeof(buf));
+	if (tetris_add_garbage(&s->game, lines, hole) & TETRIS_OVER)
+		over(m, n);
+}
+
+/*
+ * Cleared lines attack the opponent, 1 line sends nothing, 2 lines send
+ * 1, 3 send 2, 4 send 4
+ */
+static void events(struct match *m, int n, int ev)
+{
+	if (ev & TETRIS_CLEARED) {
+		int lines = __builtin_popcount(m->seat[n].game.cleared);
+
+		lines = lines == 4 ? 4 : lines - 1;
+		if (lines > 0)
+			garbage(m, !n, lines);
+	}
+	if (ev & TETRIS_OVER)
+		over(m, n);
+	if (ev & TETRIS_WON)
+		over(m, !n);
+}
+
+static void gravity(struct match *m, uint64_t now)
+{
+	int n;
+
+	for (n = 0; n < 2; n++) {
+		struct seat *s = &m->seat[n];
+
+		const uint64_t due = (now - s->epoch) * TETRIS_HZ / 1000000000ULL;
+
+		while (m->state == PLAYING && s->ticks < due) {
+			s->ticks++;
+			events(m, n, tetris_step(&s->game, TETRIS_TICK));
+		}
+	}
+}
+
+/* Both seats get the same shapes, on a fresh board */
+static void start(struct match *m)
+{
+	const uint64_t seed = (uint64_t)time(NULL) ^ ((uint64_t)m->id << 32);
+	const uint64_t now = now_ns();
+	int n;
+
+	for (n = 0; n < 2; n++) {
+		struct seat *s = &m->seat[n];
+
+		tetris_init(&s->game, seed, TETRIS_BAG);
+		s->epoch = now;
+		s->ticks = 0;
+	}
+	m->state = PLAYING;
+}
+
+static struct match *match_new(void)
+{
+	struct match *m;
+	int n;
+
+	m = calloc(1, sizeof(*m));
+	if (!m)
+		return NULL;
+
+	match_id = (match_id + 1) & 0xffff;
+	if (!match_id)
+		match_id++;	/* 0 means the latest match */
+	m->id = match_id;
+	for (n = 0; n < 2; n++) {
+		tetris_init(&m->seat[n].game, 0, 0);
+		m->seat[n].points = -1;
+	}
+	m->next = matches;
+	matches = m;
+
+	return m;
+}
+
+static void match_free(struct match *m)
+{
+	struct match **pp;
+
+	for (pp = &matches; *pp; pp = &(*pp)->next) {
+		if (*pp == m) {
+			*pp = m->next;
+			break;
+		}
+	}
+	free(m);
+}
+
+/* Hello, and what the other clients already have on their screen */
+static void welcome(struct client *c)
+{
+	struct match *m = c->match;
+	unsigned char hello[4 + 7], board[2][4 + B_SIZE], stat[2][4 + 16];
+	struct iovec iov[5];
+	int cnt = 0, n;
+
+	hello[0] = MSG_HELLO;
+	hello[1] = c->seat;
+	put16(&hello[2], 7);
+	put16(&hello[4], m->id);
+	hello[6] = c->seat < 0 ? 0xff : c->seat;
+	hello[7] = m->seat[0].game.width;
+	hello[8] = m->seat[0].game.height;
+	hello[9] = B_COLS;
+	hello[10] = B_ROWS;
+	iov[cnt].iov_base = hello;
+	iov[cnt++].iov_len = sizeof(hello);
+
+	for (n = 0; n < 2; n++) {
+		struct seat *s = &m->seat[n];
+
+		board[n][0] = MSG_BOARD;
+		board[n][1] = n;
+		put16(&board[n][2], B_SIZE);
+		memcpy(&board[n][4], s->shadow, B_SIZE);
+		iov[cnt].iov_base = board[n];
+		iov[cnt++].iov_len = sizeof(board[n]);
+
+		if (s->points < 0)
+			continue;
+		stat[n][0] = MSG_STATUS;
+		stat[n][1] = n;
+		put16(&stat[n][2], 16);
+		put32(put32(put64(&stat[n][4], s->points), s->level), s->lines);
+		iov[cnt].iov_base = stat[n];
+		iov[cnt++].iov_len = sizeof(stat[n]);
+	}
+
+	client_send(c, iov, cnt);
+}
+
+static void join_play(struct client *c)
+{
+	struct match *m;
+
+	for (m = matches; m; m = m->next) {
+		if (m->state == WAITING && m->seat[0].player && !m->seat[1].player)
+			break;
+	}
+
+	if (m) {
+		c->seat = 1;
+	} else {
+		m = match_new();
+		if (!m) {
+			client_kill(c);
+			return;
+		}
+		c->seat = 0;
+	}
+
+	c->match = m;
+	m->seat[c->seat].player = c;
+	m->clients++;
+	if (c->seat == 1)
+		start(m);
+
+	welcome(c);
+}
+
+static void join_watch(struct client *c, unsigned id)
+{
+	struct match *m;
+
+	for (m = matches; m && id && m->id != id; m = m->next)
+		;
+	if (!m) {
+		client_kill(c);
+		return;
+	}
+
+	c->seat = -1;
+	c->match = m;
+	c->next = m->watchers;
+	if (m->watchers)
+		m->watchers->prev = c;
+	m->watchers = c;
+	m->clients++;
+
+	welcome(c);
+}
+
+static void client_read(struct client *c)
+{
+	unsigned char buf[512];
+	ssize_t num, i;
+
+	num = read(c->fd, buf, sizeof(buf));
+	if (num <= 0) {
+		if (num < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+			return;
+		client_kill(c);
+		return;
+	}
+
+	for (i = 0; i < num && !c->dead; i++) {
+		struct match *m = c->match;
+
+		if (!m) {
+			c->hello[c->hello_len++] = buf[i];
+			if (c->hello[0] == 'p')
+				join_play(c);
+			else if (c->hello[0] != 's')
+				client_kill(c);
+			else if (c->hello_len == 3)
+				join_watch(c, c->hello[1] | c->hello[2] << 8);
+			continue;
+		}
+
+		if (c->seat < 0 || m->state != PLAYING)
+			continue;	/* watchers only watch */
+		if (buf[i] >= TETRIS_LEFT && buf[i] <= TETRIS_HOLD)
+			events(m, c->seat, tetris_step(&m->seat[c->seat].game, buf[i]));
+	}
+}
+
+/*
+ * Detach and free the dead, a player leaving a running match loses it.
+ * One leaving before the match started closes it, watchers and all.
+ */
+static void reap(void)
+{
+	while (dead) {
+		struct client *c = dead;
+		struct match *m = c->match;
+
+		dead = c->reap;
+		if (m) {
+			if (c->seat < 0) {
+				if (c->prev)
+					c->prev->next = c->next;
+				else
+					m->watchers = c->next;
+				if (c->next)
+					c->next->prev = c->prev;
+			} else {
+				m->seat[c->seat].player = NULL;
+				if (m->state == WAITING) {
+					struct client *w;
+
+					m->state = DONE;
+					for (w = m->watchers; w; w = w->next)
+						client_kill(w);
+				}
+				over(m, c->seat);
+			}
+			if (!--m->clients)
+				match_free(m);
+		}
+
+		close(c->fd);
+		free(c->out);
+		free(c);
+	}
+}
+
+static void frame(void)
+{
+	const uint64_t now = now_ns();
+	struct match *m;
+
+	for (m = matches; m; m = m->next) {
+		if (m->state == PLAYING)
+			gravity(m, now);
+		seat_frame(m, 0);
+		seat_frame(m, 1);
+		broadcast(m);
+	}
+}
+
+static void accept_all(int sd)
+{
+	struct epoll_event ev = { .events = EPOLLIN };
+	struct client *c;
+	int fd, on = 1;
+
+	while ((fd = accept4(sd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+		c = calloc(1, sizeof(*c));
+		if (!c) {
+			close(fd);
+			continue;
+		}
+
+		/* Frames are batched already, send them right away */
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+		c->fd = fd;
+		ev.data.ptr = c;
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev)) {
+			close(fd);
+			free(c);
+		}
+	}
+}
+
+static int listen_on(const char *port)
+{
+	struct addrinfo hints = {
+		.ai_flags    = AI_PASSIVE,
+		.ai_family   = AF_UNSPEC,
+		.ai_socktype = SOCK_STREAM,
+	};
+	struct addrinfo *res, *ai;
+	int sd = -1, on = 1, rc;
+
+	rc = getaddrinfo(NULL, port, &hints, &res);
+	if (rc) {
+		fprintf(stderr, "ERROR: port %s: %s\n", port, gai_strerror(rc));
+		return -1;
+	}
+
+	for (ai = res; ai; ai = ai->ai_next) {
+		sd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (sd == -1)
+			continue;
+
+		setsockopt(sd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+		if (!bind(sd, ai->ai_addr, ai->ai_addrlen) && !listen(sd, SOMAXCONN))
+			break;
+
+		close(sd);
+		sd = -1;
+	}
+	freeaddrinfo(res);
+
+	if (sd == -1)
+		fprintf(stderr, "ERROR: cannot listen on port %s: %s\n", port, strerror(errno));
+
+	return sd;
+}
+
+/*
+ * One loop for everything: the listening socket, every client, and a
+ * periodic timerfd that runs gravity of all matches and broadcasts the
+ * frame.  Returns when *running is cleared, e.g. by SIGINT.
+ */
+int server_run(const char *port, volatile sig_atomic_t *running)
+{
+	const struct itimerspec its = {
+		.it_interval = { 0, SERVER_FRAME * 1000000L },
+		.it_value    = { 0, SERVER_FRAME * 1000000L },
+	};
+	struct epoll_event ev = { .events = EPOLLIN }, evs[MAX_EVENTS];
+	int sd, tfd, i, num;
+
+	signal(SIGPIPE, SIG_IGN);
+
+	sd = listen_on(port);
+	if (sd == -1)
+		return 1;
+
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (epfd == -1 || tfd == -1 || timerfd_settime(tfd, 0, &its, NULL)) {
+		perror("server");
+		return 1;
+	}
+
+	ev.data.ptr = &listen_tag;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, sd, &ev);
+	ev.data.ptr = &timer_tag;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &ev);
+
+	printf("Listening on port %s\n", port);
+	fflush(stdout);
+
+	while (*running) {
+		num = epoll_wait(epfd, evs, MAX_EVENTS, -1);
+		if (num < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("epoll_wait");
+			break;
+		}
+
+		for (i = 0; i < num; i++) {
+			struct client *c = evs[i].data.ptr;
+
+			if (evs[i].data.ptr == &listen_tag) {
+				accept_all(sd);
+			} else if (evs[i].data.ptr == &timer_tag) {
+				uint64_t expired;
+
+				if (read(tfd, &expired, sizeof(expired)) > 0)
+					frame();
+			} else if (!c->dead) {
+				if (evs[i].events & (EPOLLERR | EPOLLHUP))
+					client_kill(c);
+				else if (evs[i].events & EPOLLOUT)
+					client_flush(c);
+				if (!c->dead && (evs[i].events & EPOLLIN))
+					client_read(c);
+			}
+		}
+		reap();
+	}
+
+	/* Clients and matches go with the process */
+	close(tfd);
+	close(sd);
+	close(epfd);
+
+	return 0;
+}
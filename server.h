@@ -0,0 +1,46 @@
+/* Micro Tetris, tournament server, many games over one epoll loop
+ *
+ * Copyright (c) 2025  julmajustus <julmajustus@tutanota.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#ifndef TETRIS_SERVER_H_
+#define TETRIS_SERVER_H_
+
+#include <signal.h>
+
+/*
+ * Head-to-head games and spectators over TCP, all binary.  A client
+ * starts by sending 'p' to play, it is seated in the next match with
+ * a free seat, or 's' and a 16-bit match id to watch, 0 for the latest
+ * match.  After that players send TETRIS_* inputs, one byte each, and
+ * gravity runs on the server.
+ *
+ * The server sends messages, a header of type, seat and 16-bit payload
+ * length, followed by the payload.  All numbers are little endian.
+ * Messages for one frame, SERVER_FRAME ms, go out in one writev().
+ */
+#define SERVER_FRAME      16		/* ms between broadcasts */
+
+#define MSG_HELLO         1	/* u16 match, u8 your seat or 0xff, u8 width, u8 height,
+				 * u8 cols, u8 rows: cell y * cols + x, x 1..width,
+				 * y 1..height, in MSG_BOARD and MSG_DIFF */
+#define MSG_BOARD         2	/* color of every cell, u8[cols * rows] */
+#define MSG_DIFF          3	/* cells changed since last frame, n * (u16 cell, u8 color) */
+#define MSG_STATUS        4	/* i64 points, u32 level, u32 lines */
+#define MSG_GARBAGE       5	/* u8 lines, u8 hole column, received by seat */
+#define MSG_OVER          6	/* seat topped out or left, the other one won */
+
+int server_run(const char *port, volatile sig_atomic_t *running);
+
+#endif /* TETRIS_SERVER_H_ */
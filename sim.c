@@ -0,0 +1,214 @@
+/* Micro Tetris, batch self-play of the autoplayer
+ *
+ * Copyright (c) 2025  julmajustus <julmajustus@tutanota.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bot.h"
+#include "engine.h"
+#include "sim.h"
+
+#define BUCKETS 48		/* log2 buckets, 0, 1, 2-3, 4-7, ... */
+#define CHUNK   4		/* games taken from the queue at a time */
+
+struct stats {
+	long games;
+	long pieces;
+	long lines;
+	long capped;		/* games stopped at SIM_PIECES */
+	long score[BUCKETS];
+	long lines_hist[BUCKETS];
+	long level[BUCKETS];
+};
+
+/*
+ * Every worker plays whole games on its own game state and stats, the
+ * only thing shared is the counter handing out the next seeds.
+ */
+struct worker {
+	pthread_t     tid;
+	struct stats  st;
+	char          pad[64];	/* keep neighbours off our cache line */
+};
+
+static atomic_long next_game;
+static long     num_games;
+static uint64_t base_seed;
+static int      game_flags;
+static int      game_width, game_height;
+static int      game_lookahead;
+
+static int bucket(long val)
+{
+	int b = 0;
+
+	while (val > 0 && b < BUCKETS - 1) {
+		val >>= 1;
+		b++;
+	}
+
+	return b;
+}
+
+static void play(struct stats *st, uint64_t seed)
+{
+	struct tetris_game game;
+
+	tetris_init_size(&game, seed, game_flags, game_width, game_height);
+	while (!game.over && game.pieces < SIM_PIECES) {
+		int moves[BOT_MOVES], len, i;
+
+		len = bot_plan(&game, game_lookahead, moves);
+		for (i = 0; i < len; i++)
+			tetris_step(&game, moves[i]);
+		while (!(tetris_step(&game, TETRIS_TICK) & TETRIS_LOCKED))
+			;
+	}
+
+	st->games++;
+	st->pieces += game.pieces;
+	st->lines  += game.lines;
+	if (!game.over)
+		st->capped++;
+	st->score[bucket(game.points * game.level)]++;
+	st->lines_hist[bucket(game.lines)]++;
+	st->level[bucket(game.level)]++;
+}
+
+static void *worker(void *arg)
+{
+	struct worker *w = arg;
+
+	for (;;) {
+		long i = atomic_fetch_add_explicit(&next_game, CHUNK, memory_order_relaxed);
+		long end = i + CHUNK;
+
+		if (i >= num_games)
+			break;
+		if (end > num_games)
+			end = num_games;
+
+		for (; i < end; i++)
+			play(&w->st, base_seed + i);
+	}
+
+	return NULL;
+}
+
+static void merge(struct stats *sum, const struct stats *st)
+{
+	int b;
+
+	sum->games  += st->games;
+	sum->pieces += st->pieces;
+	sum->lines  += st->lines;
+	sum->capped += st->capped;
+	for (b = 0; b < BUCKETS; b++) {
+		sum->score[b]      += st->score[b];
+		sum->lines_hist[b] += st->lines_hist[b];
+		sum->level[b]      += st->level[b];
+	}
+}
+
+static void histogram(const char *name, const long *hist, long games)
+{
+	int b, min = -1, max = 0;
+
+	printf("\n%s\n", name);
+	for (b = 0; b < BUCKETS; b++) {
+		if (!hist[b])
+			continue;
+		if (min < 0)
+			min = b;
+		max = b;
+	}
+
+	for (b = min; min >= 0 && b <= max; b++) {
+		long lo = b ? 1L << (b - 1) : 0;
+		long hi = b ? (1L << b) - 1 : 0;
+		int bar = games ? (int)(hist[b] * 50 / games) : 0;
+
+		printf("  %9ld - %-9ld %8ld  %.*s\n", lo, hi, hist[b], bar,
+		       "##################################################");
+	}
+}
+
+int simulate(long games, int threads, uint64_t seed, int flags, int width, int height,
+	     int lookahead)
+{
+	struct worker *pool;
+	struct stats sum;
+	struct timespec t0, t1;
+	double sec;
+	int started, i;
+
+	if (games < 1 || threads < 1)
+		return 1;
+
+	pool = calloc(threads, sizeof(*pool));
+	if (!pool) {
+		perror("calloc");
+		return 1;
+	}
+
+	atomic_store(&next_game, 0);
+	num_games = games;
+	base_seed = seed;
+	game_flags = flags;
+	game_width = width;
+	game_height = height;
+	game_lookahead = lookahead;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (started = 0; started < threads; started++) {
+		if (pthread_create(&pool[started].tid, NULL, worker, &pool[started])) {
+			perror("pthread_create");
+			break;
+		}
+	}
+	if (!started)
+		worker(&pool[0]);	/* no threads at all, play here */
+
+	memset(&sum, 0, sizeof(sum));
+	for (i = 0; i < threads; i++) {
+		if (i < started)
+			pthread_join(pool[i].tid, NULL);
+		merge(&sum, &pool[i].st);
+	}
+	threads = started ? started : 1;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	sec = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+	printf("%ld games, seeds %llu-%llu, %d threads, %.2f s, %.0f shapes/s\n",
+	       sum.games, (unsigned long long)seed, (unsigned long long)(seed + games - 1),
+	       threads, sec, sum.pieces / sec);
+	printf("%.1f lines and %.1f shapes per game, %ld stopped at %d shapes\n",
+	       sum.lines / (double)sum.games, sum.pieces / (double)sum.games,
+	       sum.capped, SIM_PIECES);
+
+	histogram("Score (points x level)", sum.score, sum.games);
+	histogram("Lines", sum.lines_hist, sum.games);
+	histogram("Level", sum.level, sum.games);
+
+	free(pool);
+
+	return 0;
+}
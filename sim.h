@@ -0,0 +1,33 @@
+/* Micro Tetris, batch self-play of the autoplayer
+ *
+ * Copyright (c) 2025  julmajustus <julmajustus@tutanota.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#ifndef TETRIS_SIM_H_
+#define TETRIS_SIM_H_
+
+#include <stdint.h>
+
+#define SIM_PIECES 10000	/* shapes per game at most, good bots never lose */
+
+/*
+ * Play games bot games, with seeds seed, seed + 1, ..., on threads
+ * threads, on a board of width x height, and print score, lines and
+ * level histograms of the lot.  The result is the same for any number
+ * of threads.
+ */
+int simulate(long games, int threads, uint64_t seed, int flags, int width, int height,
+	     int lookahead);
+
+#endif /* TETRIS_SIM_H_ */
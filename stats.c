@@ -0,0 +1,124 @@
+/* Micro Tetris, hot path timings of the tty front end
+ *
+ * Copyright (c) 2025  julmajustus <julmajustus@tutanota.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdatomic.h>
+
+#include "stats.h"
+
+struct hist {
+	atomic_uint_fast64_t count;
+	atomic_uint_fast64_t sum;
+	atomic_uint_fast64_t max;
+	atomic_uint_fast64_t bucket[STAT_BUCKETS];
+};
+
+static struct hist hist[STATS];
+
+/* Shown as, samples are divided by scale */
+static const struct {
+	const char *name;
+	const char *unit;
+	unsigned    scale;
+} info[STATS] = {
+	[STAT_LATENCY] = { "lag",   "us", 1000 },
+	[STAT_FRAME]   = { "frame", "us", 1000 },
+	[STAT_BYTES]   = { "bytes", "B",  1    },
+	[STAT_JITTER]  = { "tick",  "us", 1000 },
+};
+
+static int bucket(uint64_t val)
+{
+	int b = val ? 64 - __builtin_clzll(val) : 0;
+
+	return b < STAT_BUCKETS ? b : STAT_BUCKETS - 1;
+}
+
+void stats_add(int stat, uint64_t val)
+{
+	struct hist *h = &hist[stat];
+	uint_fast64_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+
+	atomic_fetch_add_explicit(&h->bucket[bucket(val)], 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&h->sum, val, memory_order_relaxed);
+	atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+	while (val > max && !atomic_compare_exchange_weak_explicit(&h->max, &max, val,
+								   memory_order_relaxed,
+								   memory_order_relaxed))
+		;
+}
+
+/*
+ * Value below which a q fraction of the samples are, at the upper end
+ * of its bucket, so at most twice too high.  Never above the maximum.
+ */
+uint64_t stats_quantile(int stat, double q)
+{
+	struct hist *h = &hist[stat];
+	uint64_t count = atomic_load_explicit(&h->count, memory_order_relaxed);
+	uint64_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+	uint64_t seen = 0, want = (uint64_t)(q * count);
+	int b;
+
+	if (!count)
+		return 0;
+	if (want >= count)
+		want = count - 1;
+
+	for (b = 0; b < STAT_BUCKETS; b++) {
+		seen += atomic_load_explicit(&h->bucket[b], memory_order_relaxed);
+		if (seen > want)
+			break;
+	}
+	if (b == 0)
+		return 0;
+	if (b >= 64 || (1ULL << b) - 1 > max)
+		return max;
+
+	return (1ULL << b) - 1;
+}
+
+/* One line for the HUD, name, median, 99th percentile and unit */
+void stats_line(int stat, char *buf, size_t len)
+{
+	const unsigned scale = info[stat].scale;
+
+	snprintf(buf, len, "%-5s %6llu %6llu %-3s", info[stat].name,
+		 (unsigned long long)(stats_quantile(stat, 0.5) / scale),
+		 (unsigned long long)(stats_quantile(stat, 0.99) / scale), info[stat].unit);
+}
+
+/* Summary of all of them, at exit */
+void stats_dump(FILE *fp)
+{
+	int i;
+
+	fprintf(fp, "%-8s %10s %10s %10s %10s %10s\n", "", "samples", "mean", "p50", "p99", "max");
+	for (i = 0; i < STATS; i++) {
+		struct hist *h = &hist[i];
+		const unsigned scale = info[i].scale;
+		uint64_t count = atomic_load_explicit(&h->count, memory_order_relaxed);
+		uint64_t sum = atomic_load_explicit(&h->sum, memory_order_relaxed);
+		uint64_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+		char name[16];
+
+		snprintf(name, sizeof(name), "%s/%s", info[i].name, info[i].unit);
+		fprintf(fp, "%-8s %10llu %10.1f %10.1f %10.1f %10.1f\n", name,
+			(unsigned long long)count, count ? (double)sum / count / scale : 0.0,
+			(double)stats_quantile(i, 0.5) / scale,
+			(double)stats_quantile(i, 0.99) / scale, (double)max / scale);
+	}
+}
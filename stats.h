@@ -0,0 +1,45 @@
+/* Micro Tetris, hot path timings of the tty front end
+ *
+ * Copyright (c) 2025  julmajustus <julmajustus@tutanota.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#ifndef TETRIS_STATS_H_
+#define TETRIS_STATS_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * What is measured, built with ENABLE_STATS.  Each one is a histogram
+ * of log2 buckets, updated with relaxed atomics only, so a sample can
+ * be added from anywhere, a signal handler or another thread, without
+ * a lock.
+ */
+enum {
+	STAT_LATENCY,		/* key read to the frame showing it, ns */
+	STAT_FRAME,		/* screen_update(), build and write, ns */
+	STAT_BYTES,		/* written per frame */
+	STAT_JITTER,		/* gravity frame handled after it was due, ns */
+	STATS
+};
+
+#define STAT_BUCKETS 48		/* 0, 1, 2-3, 4-7, ... */
+#define STAT_LINE    23		/* width of a stats_line() */
+
+void     stats_add      (int stat, uint64_t val);
+uint64_t stats_quantile (int stat, double q);
+void     stats_line     (int stat, char *buf, size_t len);
+void     stats_dump     (FILE *fp);
+
+#endif /* TETRIS_STATS_H_ */
@@ -21,24 +21,33 @@
  * page at IOCCC http://www.ioccc.org/1989/tromp.hint
  */
 
+#include <poll.h>
 #include <signal.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/time.h>
-#include <sys/wait.h>
-#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/timerfd.h>
+#endif
 #include <errno.h>
-#include <termios.h>
+#include <fcntl.h>
+#include <getopt.h>
 #include <time.h>
 #include <unistd.h>
-#include <limits.h>
 
-#define clrscr()       puts ("\033[2J\033[1;1H")
-#define gotoxy(x,y)    printf("\033[%d;%dH", y, x)
-#define hidecursor()   puts ("\033[?25l")
-#define showcursor()   puts ("\033[?25h")
-#define bgcolor(c,s)   printf("\033[%dm" s, c ? c + 40 : 0)
+#include "bot.h"
+#include "engine.h"
+#include "kiosk.h"
+#include "replay.h"
+#include "score.h"
+#include "screen.h"
+#include "server.h"
+#include "sim.h"
+#include "stats.h"
+#include "tty.h"
+
+#define clrscr()       out(STDOUT_FILENO, "\033[2J\033[1;1H\n\033[0;0H")
 
 #define SIGNAL(signo, cb)			\
 	sigemptyset(&sa.sa_mask);		\
@@ -47,22 +56,8 @@
 	sa.sa_handler = cb;			\
 	sigaction(signo, &sa, NULL)
 
-/* the board */
-#define      B_COLS 12
-#define      B_ROWS 23
-#define      B_SIZE (B_ROWS * B_COLS)
-
-#define TL     -B_COLS-1	/* top left */
-#define TC     -B_COLS		/* top center */
-#define TR     -B_COLS+1	/* top right */
-#define ML     -1		/* middle left */
-#define MR     1		/* middle right */
-#define BL     B_COLS-1		/* bottom left */
-#define BC     B_COLS		/* bottom center */
-#define BR     B_COLS+1		/* bottom right */
-
 /* These can be overridden by the user. */
-#define DEFAULT_KEYS "hjkl pqr"
+#define DEFAULT_KEYS "hjkl pqrciu"
 #define KEY_LEFT    0
 #define KEY_RROTATE 1
 #define KEY_ROTATE  2
@@ -71,518 +66,1105 @@
 #define KEY_PAUSE   5
 #define KEY_QUIT    6
 #define KEY_RESTART 7
-
-#define TEMP_SCORE_FILE "/tmp/tetris-tmp.scores"
-
-static char state_dir[PATH_MAX];
-static char high_score_file[PATH_MAX];
+#define KEY_HOLD    8
+#define KEY_STATS   9
+#define KEY_UNDO    10
+
+#define CLEAR_DELAY 50	/* ms, cleared rows shown blank with ENABLE_ANIMATION */
+#define BOT_RESTART 3	/* sec, result shown before the bot plays again */
+#define SYNC_QUERY  100	/* ms, to wait for the terminal to answer */
+#define DEFAULT_FPS 60	/* frames per second at most, --fps */
+#define MIN_SPEED   0.01	/* --speed of a replay, clamped to this range */
+#define MAX_SPEED   1000
+#define STATS_SHOW  500	/* ms, between updates of the stats overlay */
 
 static volatile sig_atomic_t running = 1;
+static volatile sig_atomic_t resized;	/* SIGWINCH, repaint everything */
+static int sig_pipe[2] = { -1, -1 };	/* self-pipe, wakes up the poll on a signal */
 
-static struct termios savemodes;
-static int havemodes = 0;
+static struct tty tty = { .fd = -1 };	/* stdin, taken over for the game */
 
 static char *keys = DEFAULT_KEYS;
-static int level = 1;
-static long points = 0;
-static int lines_cleared = 0;
-static int board[B_SIZE], shadow[B_SIZE];
-
-static int *peek_shape;		/* peek preview of next shape */
-static int  pcolor;
-static int *shape;
-static int  color;
-
-static int shapes[] = {
-	 7, TL, TC, MR, 2,	/* ""__   */
-	 8, TR, TC, ML, 3,	/* __""   */
-	 9, ML, MR, BC, 1,	/* "|"    */
-	 3, TL, TC, ML, 4,	/* square */
-	12, ML, BL, MR, 5,	/* |"""   */
-	15, ML, BR, MR, 6,	/* """|   */
-	18, ML, MR,  2, 7,	/* ---- sticks out */
-	 0, TC, ML, BL, 2,	/* /    */
-	 1, TC, MR, BR, 3,	/* \    */
-	10, TC, MR, BC, 1,	/* |-   */
-	11, TC, ML, MR, 1,	/* _|_  */
-	 2, TC, ML, BC, 1,	/* -|   */
-	13, TC, BC, BR, 5,	/* |_   */
-	14, TR, ML, MR, 5,	/* ___| */
-	 4, TL, TC, BC, 5,	/* "|   */
-	16, TR, TC, BC, 6,	/* |"   */
-	17, TL, MR, ML, 6,	/* |___ */
-	 5, TC, BC, BL, 6,	/* _| */
-	 6, TC, BC,  2 * B_COLS, 7, /* | sticks out */
-};
-
-static void init_high_score_file(void)
-{
-    const char *xdg = getenv("XDG_STATE_HOME");
-    const char *home = getenv("HOME");
-    const char *base;
-
-    if (xdg && *xdg) {
-        base = xdg;
-    } else if (home && *home) {
-        base = home;
-    } else {
-        fputs("ERROR: neither XDG_STATE_HOME nor HOME is set\n", stderr);
-        exit(1);
-    }
-
-    if (xdg && *xdg) {
-        if (snprintf(state_dir, sizeof state_dir, "%s/games", base) >= (int)sizeof state_dir) {
-            fputs("ERROR: state_dir path too long\n", stderr);
-            exit(1);
-        }
-    } else {
-        if (snprintf(state_dir, sizeof state_dir,
-                     "%s/.local/state/games", base) >= (int)sizeof state_dir) {
-            fputs("ERROR: state_dir path too long\n", stderr);
-            exit(1);
-        }
-    }
-
-    if (mkdir(state_dir, 0755) != 0 && errno != EEXIST) {
-        perror("mkdir(state_dir)");
-        exit(1);
-    }
-
-    if (snprintf(high_score_file, sizeof high_score_file,
-                 "%s/tetris.scores", state_dir) >= (int)sizeof high_score_file) {
-        fputs("ERROR: high_score_file path too long\n", stderr);
-        exit(1);
-    }
-}
-
-static void draw(int x, int y, int c)
-{
-	gotoxy(x, y);
-	bgcolor(c, "  ");
-}
 
-static int update(void)
+static struct tetris_game game;
+static struct tetris_history history;	/* spawn of the last shapes, for undo */
+static int undone;		/* undo used, not a high score */
+static struct screen scr;
+static struct replay rec = { .fd = -1 };	/* --record, fd -1 when not recording */
+static double speed = 1.0;	/* --speed, of --replay */
+static int profile = -1;	/* --term, output profile, -1 to detect */
+static int bot;			/* --bot, shapes of lookahead, 0 when off */
+static int width = B_WIDTH, height = B_HEIGHT;	/* --geometry */
+static long frame_us = 1000000 / DEFAULT_FPS;	/* --fps, 0 draws every change */
+
+/*
+ * Gravity, TETRIS_TICK frames counted from an epoch on CLOCK_MONOTONIC.
+ * Frame n is due at epoch + n / TETRIS_HZ, at --speed of a replay, so
+ * however late we wake up no frame is lost or doubled.
+ */
+static long long epoch;		/* ns */
+static long ticks;		/* frames stepped */
+static long armed;		/* frame the deadline is for */
+static int  replaying;		/* wake up every frame, not when tetris_idle() says */
+static struct timespec deadline;
+static int  timer_fd = -1;	/* timerfd armed to deadline, if available */
+
+/* Keys read from the tty but not yet handled */
+static char inbuf[64];
+static int  inpos, inlen;
+
+/* Frame cap, the board is drawn when dirty and next_frame has passed */
+static struct timespec next_frame;
+static int dirty = 1;
+
+#ifdef ENABLE_STATS
+static long long key_ns;	/* oldest key read, not yet on screen */
+static int show_stats;		/* overlay instead of the key help */
+static struct timespec next_stats;
+#endif
+
+/* Text to the tty with write(), the front end does not use stdio */
+static void out(int fd, const char *str)
 {
-	int x, y;
+	size_t len = strlen(str);
 
-#ifdef ENABLE_PREVIEW
-	static int shadow_preview[B_COLS * 10] = { 0 };
-	int preview[B_COLS * 10] = { 0 };
-	const int start = 5;
-
-	preview[2 * B_COLS + 1] = pcolor;
-	preview[2 * B_COLS + 1 + peek_shape[1]] = pcolor;
-	preview[2 * B_COLS + 1 + peek_shape[2]] = pcolor;
-	preview[2 * B_COLS + 1 + peek_shape[3]] = pcolor;
-
-	for (y = 0; y < 4; y++) {
-		for (x = 0; x < B_COLS; x++) {
-			if (preview[y * B_COLS + x] - shadow_preview[y * B_COLS + x]) {
-				int c = preview[y * B_COLS + x]; /* color */
-
-				shadow_preview[y * B_COLS + x] = c;
-				draw(x * 2 + 26 + 28, start + y, c);
-			}
+	while (len > 0) {
+		ssize_t num = write(fd, str, len);
+
+		if (num < 0) {
+			if (errno == EINTR)
+				continue;
+			return;
 		}
+		str += num;
+		len -= num;
 	}
-#endif
+}
 
-	/* Display board. */
-	for (y = 1; y < B_ROWS - 1; y++) {
-		for (x = 0; x < B_COLS; x++) {
-			if (board[y * B_COLS + x] - shadow[y * B_COLS + x]) {
-				int c = board[y * B_COLS + x]; /* color */
+static void out_num(int fd, long long num)
+{
+	char buf[24], *ptr = &buf[sizeof(buf) - 1];
+	unsigned long long val = num < 0 ? -(unsigned long long)num : (unsigned long long)num;
+
+	*ptr = 0;
+	do {
+		*--ptr = '0' + val % 10;
+		val /= 10;
+	} while (val);
+	if (num < 0)
+		*--ptr = '-';
+
+	out(fd, ptr);
+}
 
-				shadow[y * B_COLS + x] = c;
-				draw(x * 2 + 28, y, c);
-			}
-		}
-	}
+/* Like perror(), what failed and why, on stderr */
+static void out_error(const char *what)
+{
+	const char *why = strerror(errno);
+
+	out(STDERR_FILENO, what);
+	out(STDERR_FILENO, ": ");
+	out(STDERR_FILENO, why);
+	out(STDERR_FILENO, "\n");
+}
 
-	/* Update points and level */
-	while (lines_cleared >= 10) {
-		lines_cleared -= 10;
-		level++;
+static void ts_add(struct timespec *ts, long usec)
+{
+	ts->tv_sec  += usec / 1000000;
+	ts->tv_nsec += (usec % 1000000) * 1000;
+	if (ts->tv_nsec >= 1000000000) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000;
 	}
+}
 
-#ifdef ENABLE_SCORE
-	/* Display current level and points */
-	gotoxy(26 + 28, 2);
-	printf("\033[0mLevel  : %d", level);
-	gotoxy(26 + 28, 3);
-	printf("Points : %ld", points);
-#endif
-#ifdef ENABLE_PREVIEW
-	gotoxy(26 + 28, 5);
-	printf("Preview:");
-#endif
-	gotoxy(26 + 28, 10);
-	printf("Keys:");
-	fflush(stdout);
+/* Time left until ts, in msec rounded up, 0 if already passed */
+static int ts_left(const struct timespec *ts)
+{
+	struct timespec now;
+	long long ns;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ns = (ts->tv_sec - now.tv_sec) * 1000000000LL + ts->tv_nsec - now.tv_nsec;
+	if (ns <= 0)
+		return 0;
 
-	return getchar();
+	return (int)((ns + 999999) / 1000000);
 }
 
-/* Check if shape fits in the current position */
-static int fits_in(int *s, int pos)
+static long long now_ns(void)
 {
-	if (board[pos] || board[pos + s[1]] || board[pos + s[2]] || board[pos + s[3]])
-		return 0;
+	struct timespec now;
 
-	return 1;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static double frame_ns(void)
+{
+	return 1e9 / TETRIS_HZ / speed;
+}
+
+/* When frame n is due */
+static long long tick_ns(long n)
+{
+	return epoch + (long long)(n * frame_ns());
 }
 
-/* place shape at pos with color */
-static void place(int *s, int pos, int c)
+/* Frames that should have been stepped by now */
+static long gravity_due(void)
 {
-	board[pos] = c;
-	board[pos + s[1]] = c;
-	board[pos + s[2]] = c;
-	board[pos + s[3]] = c;
+	return (long)((now_ns() - epoch) / frame_ns());
 }
 
-static int *next_shape(void)
+/*
+ * Set the deadline to the frame where gravity next does something, the
+ * ones before are stepped in a burst then.  A microsecond late, so that
+ * gravity_due() has surely counted that frame when we wake up.
+ */
+static void gravity_arm(void)
 {
-	int  pos  = rand() % 7 * 5;
-	int *next = peek_shape;
+	int idle = replaying ? 1 : tetris_idle(&game);
+	long long ns = tick_ns(armed = ticks + (idle > 0 ? idle : 1)) + 1000;
+	struct timespec ts = { ns / 1000000000LL, ns % 1000000000LL };
+
+	if (ts.tv_sec == deadline.tv_sec && ts.tv_nsec == deadline.tv_nsec)
+		return;
+	deadline = ts;
+
+#ifdef __linux__
+	if (timer_fd != -1) {
+		struct itimerspec its = { .it_value = deadline };
+
+		timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+	}
+#endif
+}
 
-	peek_shape = &shapes[pos];
-	pcolor = peek_shape[4];
-	if (!next)
-		return next_shape();
-	color = next[4];
+static void gravity_start(void)
+{
+	epoch = now_ns();
+	ticks = 0;
+}
+
+/* Continue from the frame we paused at */
+static void gravity_resume(void)
+{
+	epoch = now_ns() - (long long)(ticks * frame_ns());
+}
+
+/*
+ * Poll the tty, the timerfd and the signal pipe, the ones that are open,
+ * read all keys that are pending.  A signal only wakes us up, running
+ * and resized tell what it was.
+ */
+static int input_fill(int timeout)
+{
+	struct pollfd pfd[3] = {
+		{ .fd = STDIN_FILENO, .events = POLLIN },
+		{ .fd = timer_fd,     .events = POLLIN },
+		{ .fd = sig_pipe[0],  .events = POLLIN },
+	};
+	int num;
+
+	num = poll(pfd, 3, timeout);
+	if (num <= 0)
+		return num;
+
+	if (pfd[2].revents & POLLIN) {
+		char buf[16];
+
+		while (read(sig_pipe[0], buf, sizeof(buf)) > 0)
+			;
+		if (!running)
+			return 0;
+	}
+
+	if (pfd[1].revents & POLLIN) {
+		uint64_t expired;
+
+		/* Only drains it, wait_input() checks the clock itself */
+		if (read(timer_fd, &expired, sizeof(expired)) < 0)
+			return -1;
+	}
+
+	if (pfd[0].revents) {
+		num = read(STDIN_FILENO, inbuf, sizeof(inbuf));
+		if (num <= 0) {
+			/* EOF or tty gone, nothing more to play with */
+			if (num == 0 || errno != EINTR)
+				running = 0;
+			return -1;
+		}
+		inpos = 0;
+		inlen = num;
+#ifdef ENABLE_STATS
+		if (!key_ns)
+			key_ns = now_ns();
+#endif
+	}
 
-	return next;
+	return 1;
 }
 
-static void show_high_score(void)
+/* Blocking read of the next key, gravity is not running */
+static int getkey(void)
 {
-#ifdef ENABLE_HIGH_SCORE
-    FILE *tmpscore;
+	while (running && inpos == inlen)
+		input_fill(-1);
+
+	if (inpos == inlen)
+		return 0;
 
-    if ((tmpscore = fopen(high_score_file, "a"))) {
-        char *name = getenv("LOGNAME");
+	return inbuf[inpos++];
+}
 
-        if (!name)
-            name = "anonymous";
+/*
+ * Wait for a key or the next gravity tick, whatever comes first.  Due
+ * ticks go before keys, so each key lands on the frame it was read in.
+ * On Linux the deadline is a timerfd polled together with the tty,
+ * elsewhere the poll timeout is computed from it.  With a frame to draw
+ * the wait also ends when it is due.  Returns the key, -1 on gravity
+ * tick, or 0 when interrupted or time to draw.
+ */
+static int wait_input(void)
+{
+	while (running) {
+		int left, timeout;
+
+		if (ticks < gravity_due()) {
+			ticks++;
+#ifdef ENABLE_STATS
+			/* How late we woke up, for the frame we slept until */
+			if (ticks == armed)
+				stats_add(STAT_JITTER, now_ns() - tick_ns(ticks));
+#endif
+			return -1;
+		}
+		if (inpos < inlen)
+			break;
 
-        fprintf(tmpscore, "%7ld\t %5ld\t  %3d\t%s\n",
-                (long)points * level,
-                (long)points,
-                level,
-                name);
-        fclose(tmpscore);
+		gravity_arm();
+		left = ts_left(&deadline);
+		timeout = timer_fd == -1 ? left : -1;
+		if (left == 0)
+			continue;
 
-        char cmd[PATH_MAX * 2 + 128];
+		if (dirty) {
+			int frame = ts_left(&next_frame);
 
-        snprintf(cmd, sizeof(cmd),
-            "cat \"%s\" | sort -rn | head -10 > \"%s\" && "
-            "cp \"%s\" \"%s\"",
-            high_score_file, TEMP_SCORE_FILE,
-            TEMP_SCORE_FILE, high_score_file);
+			if (frame == 0)
+				return 0;
+			if (timeout == -1 || frame < timeout)
+				timeout = frame;
+		}
 
-        system(cmd);
-        remove(TEMP_SCORE_FILE);
-    }
+		if (input_fill(timeout) < 0 && errno == EINTR)
+			return 0;
+	}
 
-    if (access(high_score_file, R_OK) == 0) {
-        fprintf(stderr, "  Score\tPoints\tLevel\tName\n");
+	if (inpos == inlen)
+		return 0;
 
-        char view_cmd[PATH_MAX + 32];
-        snprintf(view_cmd, sizeof(view_cmd),
-            "cat \"%s\"",
-            high_score_file);
-        system(view_cmd);
-    }
-#endif /* ENABLE_HIGH_SCORE */
+	return inbuf[inpos++];
 }
 
 static void show_online_help(void)
 {
+	static const char *help[] = {
+		"h     - left",
+		"j     - reverse rotate",
+		"k     - rotate",
+		"l     - right",
+		"space - drop",
+		"c     - hold",
+		"u     - undo",
+		"p     - pause",
+		"r     - restart",
+		"q     - quit",
+#ifdef ENABLE_STATS
+		"i     - stats",
+#endif
+	};
 	const int start = 11;
+	size_t i;
+
+	for (i = 0; i < sizeof(help) / sizeof(help[0]); i++) {
+#ifdef ENABLE_STATS
+		/* Same place and width, each overwrites the other */
+		char line[STAT_LINE + 1];
+
+		if (!show_stats)
+			snprintf(line, sizeof(line), "%-*s", STAT_LINE, help[i]);
+		else if (i == 0)
+			snprintf(line, sizeof(line), "%-*s", STAT_LINE, "         p50    p99");
+		else if (i <= STATS)
+			stats_line(i - 1, line, sizeof(line));
+		else
+			snprintf(line, sizeof(line), "%*s", STAT_LINE, "");
+		screen_text(&scr, SCREEN_HUD_X(&game), start + i, line);
+#else
+		screen_text(&scr, SCREEN_HUD_X(&game), start + i, help[i]);
+#endif
+	}
+}
 
-	gotoxy(26 + 28, start);
-	puts("\033[0mh     - left");
-	gotoxy(26 + 28, start + 1);
-	puts("j     - reverse rotate");
-	gotoxy(26 + 28, start + 2);
-	puts("k     - rotate");
-	gotoxy(26 + 28, start + 3);
-	puts("l     - right");
-	gotoxy(26 + 28, start + 4);
-	puts("space - drop");
-	gotoxy(26 + 28, start + 5);
-	puts("p     - pause");
-	gotoxy(26 + 28, start + 6);
-	puts("r     - restart");
-	gotoxy(26 + 28, start + 7);
-	puts("q     - quit");
-}
-
-/* Code stolen from http://c-faq.com/osdep/cbreak.html */
-static int tty_init(void)
+#ifdef ENABLE_BOT
+/* Autoplayer's plan for the current shape, as keys */
+static int  bot_moves[BOT_MOVES];
+static int  bot_pos, bot_len;
+static long bot_pieces = -1;	/* shape the plan is for */
+
+/* Next key of the plan, 0 when the shape is dropped, waiting for gravity */
+static int bot_key(void)
 {
-	struct termios modmodes;
+	static const int key[] = {
+		[TETRIS_LEFT]    = KEY_LEFT,
+		[TETRIS_RIGHT]   = KEY_RIGHT,
+		[TETRIS_ROTATE]  = KEY_ROTATE,
+		[TETRIS_RROTATE] = KEY_RROTATE,
+		[TETRIS_DROP]    = KEY_DROP,
+	};
+
+	if (bot_pieces != game.pieces) {
+		bot_pieces = game.pieces;
+		bot_len = bot_plan(&game, bot, bot_moves);
+		bot_pos = 0;
+	}
 
-	if (tcgetattr(fileno(stdin), &savemodes) < 0)
-		return -1;
+	if (bot_pos == bot_len)
+		return 0;
+
+	return keys[key[bot_moves[bot_pos++]]];
+}
+#endif
 
-	havemodes = 1;
-	hidecursor();
+/*
+ * Draw the board, at most once per frame, and get the next input.  Keys
+ * already read are handled first, a burst of autorepeat is applied to
+ * the game in one go and only the end result is drawn.
+ */
+static int update(void)
+{
+	if (resized) {
+		/* The terminal may have reflowed or cleared it, start over */
+		resized = 0;
+		dirty = 1;
+		screen_clear(&scr);
+		show_online_help();
+	}
 
-	/* "stty cbreak -echo" */
-	modmodes = savemodes;
-	modmodes.c_lflag &= ~ICANON;
-	modmodes.c_lflag &= ~ECHO;
-	modmodes.c_cc[VMIN] = 1;
-	modmodes.c_cc[VTIME] = 0;
+	if (dirty && inpos == inlen && ticks >= gravity_due() && ts_left(&next_frame) == 0) {
+#ifdef ENABLE_STATS
+		unsigned long bytes = scr.bytes;
+		long long t = now_ns();
 
-	return tcsetattr(fileno(stdin), TCSANOW, &modmodes);
+		if (show_stats && ts_left(&next_stats) == 0) {
+			show_online_help();
+			clock_gettime(CLOCK_MONOTONIC, &next_stats);
+			ts_add(&next_stats, STATS_SHOW * 1000);
+		}
+#endif
+		screen_update(&scr, &game);
+		dirty = 0;
+#ifdef ENABLE_STATS
+		stats_add(STAT_FRAME, now_ns() - t);
+		stats_add(STAT_BYTES, scr.bytes - bytes);
+		if (key_ns) {
+			stats_add(STAT_LATENCY, now_ns() - key_ns);
+			key_ns = 0;
+		}
+#endif
+
+		clock_gettime(CLOCK_MONOTONIC, &next_frame);
+		ts_add(&next_frame, frame_us);
+	}
+
+#ifdef ENABLE_BOT
+	/* The bot types its keys as fast as they are read, the tty goes first */
+	if (bot && inpos == inlen && !game.over) {
+		int c = bot_key();
+
+		if (c)
+			return c;
+	}
+#endif
+
+	return wait_input();
 }
 
-static int tty_exit(void)
+/*
+ * Replies to the queries below, CSI ? ... final.  Returns REPLY_SYNC if
+ * mode 2026 is known, set or reset, and REPLY_DA once primary DA is in.
+ * Anything else was typed, and is kept as keys, if keep is set.
+ */
+#define REPLY_SYNC 1
+#define REPLY_DA   2
+
+static int tty_replies(const char *buf, int len, int keep)
 {
-	if (!havemodes)
+	int found = 0, i;
+
+	for (i = 0; i < len; i++) {
+		int j = i + 3;
+
+		if (buf[i] != 033 || i + 2 >= len || buf[i + 1] != '[' || buf[i + 2] != '?') {
+			if (keep && inlen < (int)sizeof(inbuf))
+				inbuf[inlen++] = buf[i];
+			continue;
+		}
+
+		while (j < len && (buf[j] < 0x40 || buf[j] > 0x7e))
+			j++;
+		if (j == len)
+			break;		/* not all in yet */
+
+		/* CSI ? 2026 ; Ps $ y */
+		if (buf[j] == 'y' && j - i > 9 && !strncmp(&buf[i + 3], "2026;", 5) &&
+		    (buf[i + 8] == '1' || buf[i + 8] == '2'))
+			found |= REPLY_SYNC;
+		if (buf[j] == 'c')
+			found |= REPLY_DA;
+		i = j;
+	}
+
+	return found;
+}
+
+/*
+ * Ask the terminal if it does synchronized updates, DECRQM for mode
+ * 2026.  Primary DA is asked last, every terminal answers that one, so
+ * we know when to stop waiting.  Keys typed meanwhile are kept.
+ */
+static int tty_has_sync(void)
+{
+	static const char query[] = "\033[?2026$p\033[c";
+	struct timespec until;
+	char buf[64];
+	int len = 0;
+
+	if (write(STDOUT_FILENO, query, sizeof(query) - 1) < 0)
 		return 0;
 
-	showcursor();
+	clock_gettime(CLOCK_MONOTONIC, &until);
+	ts_add(&until, SYNC_QUERY * 1000);
+	while (len < (int)sizeof(buf)) {
+		struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
+		int num;
+
+		if (poll(&pfd, 1, ts_left(&until)) <= 0)
+			break;
+		num = read(STDIN_FILENO, &buf[len], sizeof(buf) - len);
+		if (num <= 0)
+			break;
+		len += num;
+		if (tty_replies(buf, len, 0) & REPLY_DA)
+			break;
+	}
 
-	/* "stty sane" */
-	return tcsetattr(fileno(stdin), TCSANOW, &savemodes);
+	return tty_replies(buf, len, 1) & REPLY_SYNC;
 }
 
-static void freeze(int enable)
+static int tty_init(void)
 {
-	sigset_t set;
+	if (tty_cbreak(&tty, STDIN_FILENO))
+		return -1;
 
-	sigemptyset(&set);
-	sigaddset(&set, SIGALRM);
+	/* Serial lines get no extras, every byte counts there */
+	scr.profile = profile < 0 ? screen_detect() : profile;
+	if (scr.profile != SCREEN_MONO)
+		scr.sync = tty_has_sync();
+	screen_enter(&scr);
 
-	sigprocmask(enable ? SIG_BLOCK : SIG_UNBLOCK, &set, NULL);
+	return 0;
 }
 
-static void alarm_handler(int signo)
+static int tty_exit(void)
 {
-	static long h[4];
+	if (!tty.have)
+		return 0;
 
-	(void)signo;
+	scr.sync = 0;
+	screen_leave(&scr);
 
-	/* On init from main() */
-	if (!signo)
-		h[3] = 500000;
+	return tty_restore(&tty);
+}
+
+/* Wake up the poll, if we are in it */
+static void sig_wake(void)
+{
+	const int saved = errno;
 
-	h[3] -= h[3] / (3000 - 10 * level);
-	setitimer(0, (struct itimerval *)h, 0);
+	if (sig_pipe[1] != -1 && write(sig_pipe[1], "", 1) < 0)
+		;	/* full, a wakeup is pending already */
+	errno = saved;
 }
 
+/* SIGINT, SIGTERM and SIGHUP, the normal way out: tty restored, replay saved */
 static void exit_handler(int signo)
 {
 	(void)signo;
 	running = 0;
+	sig_wake();
+}
+
+static void resize_handler(int signo)
+{
+	(void)signo;
+	resized = 1;
+	sig_wake();
 }
 
 static void sig_init(void)
 {
 	struct sigaction sa;
 
+	if (!pipe(sig_pipe)) {
+		int i;
+
+		for (i = 0; i < 2; i++) {
+			fcntl(sig_pipe[i], F_SETFL, O_NONBLOCK);
+			fcntl(sig_pipe[i], F_SETFD, FD_CLOEXEC);
+		}
+	}
+
 	SIGNAL(SIGINT, exit_handler);
 	SIGNAL(SIGTERM, exit_handler);
-	SIGNAL(SIGALRM, alarm_handler);
-
-	/* Start update timer. */
-	alarm_handler(0);
-}
-static void init(int *c, int *pos ) 
-{
-	int i, *ptr;
-
-	level = 1;
-	points = 0;
-	lines_cleared = 0;
-	*c = 0;
-	*pos = 17;
-	ptr = board;
-	
-	/* Initialize board, grey border, used to be white(7) */
-	for (i = B_SIZE; i; i--)
-		*ptr++ = i < 25 || i % B_COLS < 2 ? 60 : 0;
-	for (i = B_SIZE; i--; shadow[i] = 0)
-		;
-	clrscr();
-	/* Set up signals */
-	alarm_handler(0);
+	SIGNAL(SIGHUP, exit_handler);
+	SIGNAL(SIGWINCH, resize_handler);
+
+#ifdef __linux__
+	timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+#endif
+}
+/* Fresh screen and gravity for a new game */
+static void init(void)
+{
+	history.len = 0;
+	tetris_push(&history, &game);
+	undone = 0;
+
+	screen_clear(&scr);
+	/* Start gravity */
+	gravity_start();
 	show_online_help();
-	shape = next_shape();
+	dirty = 1;
+#ifdef ENABLE_BOT
+	bot_pieces = -1;
+#endif
+}
+
+static void restart(void)
+{
+	replay_record(&rec, REPLAY_RESET);
+	tetris_reset(&game);
+	init();
+}
+
+/* Map keys[] to engine input, -1 if not a game key */
+static int key_input(int c)
+{
+	if (c == keys[KEY_LEFT])
+		return TETRIS_LEFT;
+	if (c == keys[KEY_ROTATE])
+		return TETRIS_ROTATE;
+	if (c == keys[KEY_RROTATE])
+		return TETRIS_RROTATE;
+	if (c == keys[KEY_RIGHT])
+		return TETRIS_RIGHT;
+	if (c == keys[KEY_DROP])
+		return TETRIS_DROP;
+	if (c == keys[KEY_HOLD])
+		return TETRIS_HOLD;
+
+	return -1;
+}
+
+static void show_score(void)
+{
+	out(STDOUT_FILENO, "\033[0mYour score: ");
+	out_num(STDOUT_FILENO, game.points);
+	out(STDOUT_FILENO, " points x level ");
+	out_num(STDOUT_FILENO, game.level);
+	out(STDOUT_FILENO, " = ");
+	out_num(STDOUT_FILENO, game.points * game.level);
+	out(STDOUT_FILENO, "\n\n");
 }
 
-int main(void)
+static void show_result(const struct tetris_game *g)
 {
-	int i, c = 0, pos;
-	int *backup;
+	out(STDOUT_FILENO, "seed ");
+	out_num(STDOUT_FILENO, (long long)g->seed);
+	out(STDOUT_FILENO, ": ");
+	out_num(STDOUT_FILENO, g->points);
+	out(STDOUT_FILENO, " points, level ");
+	out_num(STDOUT_FILENO, g->level);
+	out(STDOUT_FILENO, ", ");
+	out_num(STDOUT_FILENO, g->lines);
+	out(STDOUT_FILENO, " lines, ");
+	out_num(STDOUT_FILENO, g->pieces);
+	out(STDOUT_FILENO, " shapes\n");
+}
+
+/* Run a replay through the engine, as fast as possible, no tty needed */
+static int verify(struct replay *rp)
+{
+	static struct tetris_history h;
+	struct tetris_game g;
+	int ev;
+
+	while ((ev = replay_read(rp)) != REPLAY_EOF) {
+		switch (ev) {
+		case REPLAY_ERROR:
+			out(STDERR_FILENO, "ERROR: not a replay file, or unsupported version\n");
+			return 1;
+
+		case REPLAY_SESSION:
+			if (tetris_init_size(&g, rp->seed, rp->flags, rp->width, rp->height)) {
+				out(STDERR_FILENO, "ERROR: unsupported board size in replay\n");
+				return 1;
+			}
+			h.len = 0;
+			tetris_push(&h, &g);
+			break;
+
+		case REPLAY_RESET:
+		case REPLAY_END:
+			show_result(&g);
+			if (ev == REPLAY_RESET) {
+				tetris_reset(&g);
+				h.len = 0;
+				tetris_push(&h, &g);
+			}
+			break;
+
+		case REPLAY_UNDO:
+			tetris_undo(&h, &g);
+			break;
+
+		default:
+			if (tetris_step(&g, ev) & TETRIS_LOCKED)
+				tetris_push(&h, &g);
+			break;
+		}
+	}
+
+	return 0;
+}
+
+/* Show a replay on the tty, at --speed times the recorded pace */
+static void playback(struct replay *rp)
+{
+	int ev, c;
+
+	replaying = 1;
+	while (running && (ev = replay_read(rp)) != REPLAY_EOF && ev != REPLAY_ERROR) {
+		switch (ev) {
+		case REPLAY_SESSION:
+			if (tetris_init_size(&game, rp->seed, rp->flags, rp->width, rp->height))
+				return;
+			init();
+			break;
+
+		case REPLAY_RESET:
+			tetris_reset(&game);
+			init();
+			break;
+
+		case REPLAY_END:
+			break;
+
+		case REPLAY_UNDO:
+			tetris_undo(&history, &game);
+			dirty = 1;
+			break;
+
+		case TETRIS_TICK:
+			/* Show the frame and wait for the tick, any key but quit is ignored */
+			do {
+				c = update();
+			} while (running && c >= 0 && c != keys[KEY_QUIT]);
+			if (c == keys[KEY_QUIT])
+				return;
+
+			if (tetris_step(&game, TETRIS_TICK) & TETRIS_LOCKED)
+				tetris_push(&history, &game);
+			dirty = 1;
+			break;
+
+		default:
+			if (tetris_step(&game, ev) & TETRIS_LOCKED)
+				tetris_push(&history, &game);
+			dirty = 1;
+			break;
+		}
+	}
+}
+
+static int usage(int rc)
+{
+	out(STDOUT_FILENO, "Usage: tetris [OPTIONS]\n"
+	       "\n"
+	       "Options:\n"
+	       "  -b, --bag          7-bag randomizer, each shape once per bag of seven\n"
+#ifdef ENABLE_BOT
+	       "  -B, --bot[=N]      Let the computer play, restarting after each game,\n"
+	       "                     N=1 places the falling shape only, N=2 also looks\n"
+	       "                     at the preview, N=3-7 searches N shapes of the\n"
+	       "                     queue, default: 2\n"
+#endif
+	       "  -f, --fps=N        Draw at most N frames per second, 0 draws every\n"
+	       "                     change, default: 60\n"
+	       "  -g, --geometry=WxH Board of W columns and H rows, from 4x4 to 14x29,\n"
+	       "                     default: 10x20\n"
+	       "  -h, --help         This help text\n"
+#ifdef ENABLE_KIOSK
+	       "  -K, --kiosk=TTYS   A game on each tty of the comma separated list,\n"
+	       "                     e.g. /dev/tty2,/dev/tty3, all from one process\n"
+#endif
+#ifdef ENABLE_SIMULATE
+	       "  -n, --simulate=N   Let the bot play N games without a tty, using\n"
+	       "                     --seed, --bag and --bot, and print statistics\n"
+#endif
+	       "  -p, --replay=FILE  Play back sessions recorded with --record\n"
+#ifdef ENABLE_SERVER
+	       "  -P, --server=PORT  Run a tournament server for network players and\n"
+	       "                     spectators, see server.h for the protocol\n"
+#endif
+#ifdef ENABLE_PREVIEW
+	       "  -q, --queue=N      Show the next N shapes, 1-6, default: 1\n"
+#endif
+	       "  -r, --record=FILE  Append this session to a replay file\n"
+	       "  -s, --seed=SEED    Seed the shape sequence, same seed same game,\n"
+	       "                     default: current time\n"
+	       "  -S, --speed=X      Playback speed of --replay, 0.01-1000, 0 verifies the\n"
+	       "                     replay as fast as possible and prints the result,\n"
+	       "                     default: 1\n"
+#ifdef ENABLE_SIMULATE
+	       "  -t, --threads=T    Threads for --simulate, default: one per CPU\n"
+#endif
+	       "  -T, --term=NAME    Output profile: ansi16, 256, truecolor, or mono for\n"
+	       "                     slow serial lines, default: from TERM and COLORTERM\n");
+
+	return rc;
+}
+
+int main(int argc, char *argv[])
+{
+	struct option long_options[] = {
+		{ "bag",    no_argument,       NULL, 'b' },
+#ifdef ENABLE_BOT
+		{ "bot",    optional_argument, NULL, 'B' },
+#endif
+		{ "fps",    required_argument, NULL, 'f' },
+		{ "geometry", required_argument, NULL, 'g' },
+		{ "help",   no_argument,       NULL, 'h' },
+#ifdef ENABLE_KIOSK
+		{ "kiosk",  required_argument, NULL, 'K' },
+#endif
+#ifdef ENABLE_SIMULATE
+		{ "simulate", required_argument, NULL, 'n' },
+		{ "threads",  required_argument, NULL, 't' },
+#endif
+		{ "replay", required_argument, NULL, 'p' },
+#ifdef ENABLE_SERVER
+		{ "server", required_argument, NULL, 'P' },
+#endif
+#ifdef ENABLE_PREVIEW
+		{ "queue",  required_argument, NULL, 'q' },
+#endif
+		{ "record", required_argument, NULL, 'r' },
+		{ "seed",   required_argument, NULL, 's' },
+		{ "speed",  required_argument, NULL, 'S' },
+		{ "term",   required_argument, NULL, 'T' },
+		{ NULL, 0, NULL, 0 }
+	};
+	uint64_t seed = (uint64_t)time(NULL);
+	char *record = NULL, *replay = NULL, *end;
+#ifdef ENABLE_SERVER
+	char *server = NULL;
+#endif
+#ifdef ENABLE_KIOSK
+	char *kiosk = NULL;
+#endif
+	struct replay rp;
+#ifdef ENABLE_SIMULATE
+	long games = 0;
+	int threads = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	int previews = 1;
+	int flags = 0;
+	int c = 0;
+
+	while ((c = getopt_long(argc, argv, "bB::f:g:hK:n:p:P:q:r:s:S:t:T:", long_options, NULL)) != EOF) {
+		switch (c) {
+		case 'b':
+			flags |= TETRIS_BAG;
+			break;
+
+#ifdef ENABLE_BOT
+		case 'B':
+			bot = optarg ? atoi(optarg) : 2;
+			if (bot < 1 || bot > 1 + TETRIS_PREVIEWS)
+				return usage(1);
+			break;
+#endif
+
+		case 'f':
+			c = atoi(optarg);
+			if (c < 0)
+				return usage(1);
+			frame_us = c ? 1000000 / c : 0;
+			break;
+
+		case 'g':
+			width = strtol(optarg, &end, 10);
+			height = *end == 'x' ? strtol(end + 1, &end, 10) : 0;
+			if (*end || width < B_MIN_WIDTH || width > B_MAX_WIDTH ||
+			    height < B_MIN_HEIGHT || height > B_MAX_HEIGHT)
+				return usage(1);
+			break;
+
+		case 'h':
+			return usage(0);
+
+#ifdef ENABLE_KIOSK
+		case 'K':
+			kiosk = optarg;
+			break;
+#endif
+
+#ifdef ENABLE_SIMULATE
+		case 'n':
+			games = strtol(optarg, NULL, 0);
+			if (games < 1)
+				return usage(1);
+			break;
+
+		case 't':
+			threads = atoi(optarg);
+			if (threads < 1)
+				return usage(1);
+			break;
+#endif
+
+		case 'p':
+			replay = optarg;
+			break;
+
+#ifdef ENABLE_SERVER
+		case 'P':
+			server = optarg;
+			break;
+#endif
+
+#ifdef ENABLE_PREVIEW
+		case 'q':
+			previews = atoi(optarg);
+			if (previews < 1 || previews > TETRIS_PREVIEWS)
+				return usage(1);
+			break;
+#endif
+
+		case 'r':
+			record = optarg;
+			break;
+
+		case 's':
+			seed = strtoull(optarg, NULL, 0);
+			break;
+
+		case 'S':
+			speed = strtod(optarg, &end);
+			if (end == optarg || *end || !isfinite(speed) || speed < 0)
+				return usage(1);
+			if (speed && speed < MIN_SPEED)
+				speed = MIN_SPEED;
+			if (speed > MAX_SPEED)
+				speed = MAX_SPEED;
+			break;
+
+		case 'T':
+			profile = screen_profile(optarg);
+			if (profile < 0)
+				return usage(1);
+			break;
+
+		default:
+			return usage(1);
+		}
+	}
+
+	/* Live play runs at the pace of the game, --speed is for replays, 0 too */
+	if (speed != 1.0 && !replay)
+		return usage(1);
+
+#ifdef ENABLE_BOT
+	bot_use(NULL);
+#endif
+#ifdef ENABLE_SERVER
+	if (server) {
+		sig_init();
+		return server_run(server, &running);
+	}
+#endif
+#ifdef ENABLE_KIOSK
+	if (kiosk) {
+		sig_init();
+		return kiosk_run(kiosk, keys, seed, flags, width, height, previews, profile,
+				 &running);
+	}
+#endif
+#ifdef ENABLE_SIMULATE
+	if (games)
+		return simulate(games, threads > 0 ? threads : 1, seed, flags, width, height,
+				bot ? bot : 2);
+#endif
+
+	if (replay) {
+		bot = 0;
+		if (replay_open(&rp, replay)) {
+			out_error(replay);
+			return 1;
+		}
+		if (speed == 0)
+			return verify(&rp);
+	}
+
+	/* Exits on error, while the tty is still as we got it */
+	init_high_score_file();
+
+	tetris_init_size(&game, seed, flags, width, height);
+	screen_init(&scr, STDOUT_FILENO);
+	scr.previews = previews;
+	if (record && !replay && replay_create(&rec, record, &game)) {
+		out_error(record);
+		return 1;
+	}
 
-	srand((unsigned int)time(NULL));
 	if (tty_init() == -1)
 		return 1;
-	
-	init_high_score_file();
 
 	/* Set up signals */
 	sig_init();
-	
-	init(&c, &pos);
+
+	if (replay) {
+		playback(&rp);
+		running = 0;
+	} else {
+		init();
+	}
 
 	while (running) {
-		if (c < 0) {
-			if (fits_in(shape, pos + B_COLS)) {
-				pos += B_COLS;
-			} else {
-				place(shape, pos, color);
-				int clears = 0;
-				for (i = 1; i < B_ROWS-2; ++i) {
-					int full = 1;
-					for (int x = 1; x < B_COLS-1; ++x) {
-						if (!board[i * B_COLS + x]) {
-							full = 0;
-							break;
-						}
-					}
-					if (full) {
-						++clears;
-						/* clear row i */
-						for (int x = 1; x < B_COLS-1; ++x)
-							board[i * B_COLS + x] = 0;
-						c = update();
-
-						/* shift everything above row i down one */
-						for (int y = i; y > 0; --y) {
-							for (int x = 1; x < B_COLS-1; ++x)
-								board[y * B_COLS + x] = board[(y-1) * B_COLS + x];
-						}
-						c = update();
-						/* re‐check this same row index next iteration */
-						--i;
-					}
-				}
-
-				if (clears > 0) {
-					static const int score_table[5] = {
-						0,
-						40,
-						100,
-						300,
-						1200
-					};
-					double ofcheck = points + score_table[clears] * level;
-					if (ofcheck > LONG_MAX) {
-						clrscr();
-						gotoxy(0, 0);
-						printf("\n\nYOU HAVE WON\n\n");
-						printf("\033[0mYour score: %ld points x level %d = %ld\n\n", points, level, points * level);
-						show_high_score();
-						sleep(5);
-						break;
-					}
-					points += score_table[clears] * level;
-					lines_cleared += clears;
-				}
-				c = update();
-				shape = next_shape();
-				if (!fits_in(shape, pos = 17)) {
-					clrscr();
-					gotoxy(0, 0);
-					printf("");
-					printf("\n\nYOU HAVE FAILED!\n\n\033[0mYour score: %ld points x level %d = %ld\n\n", points, level, points * level);
-					show_high_score();
-					freeze(1);
-					printf("\n\nPress 'r' for replay or 'q' for quit!\n");
-					while ((c = getchar())) {
-						if (c == keys[KEY_QUIT] || c == keys[KEY_RESTART])
-							break;
-					}
-					if (c == keys[KEY_QUIT])
-						break;
-					else
-						freeze(0);
-
-					init(&c, &pos);
-					continue;
-				}
-			}
+		int events = 0;
+		int input;
+
+		c = update();
+		input = c < 0 ? TETRIS_TICK : key_input(c);
+		if (input != -1) {
+			replay_record(&rec, input);
+			events = tetris_step(&game, input);
+			if (events & TETRIS_LOCKED)
+				tetris_push(&history, &game);
+			dirty = 1;
+		}
+
+#ifdef ENABLE_ANIMATION
+		if (events & TETRIS_CLEARED) {
+			/* Cleared rows are blanked on what the player last saw */
+			struct timespec ts = { 0, CLEAR_DELAY * 1000000L };
+
+			screen_clear_rows(&scr, &game);
+			clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
 		}
+#endif
 
-		if (c == keys[KEY_LEFT]) {
-			if (!fits_in(shape, --pos))
-				++pos;
+		if (events & TETRIS_WON) {
+			clrscr();
+			out(STDOUT_FILENO, "\n\nYOU HAVE WON\n\n");
+			show_score();
+			if (!bot && !undone)
+				show_high_score(game.points, game.level);
+			sleep(5);
+			break;
 		}
 
-		if (c == keys[KEY_ROTATE]) {
-			backup = shape;
-			int curr_idx = (shape - shapes) / 5;
-			int prev_idx = curr_idx;
-			for (int i = 0; i < 19; i++) {
-				if (shapes[5*i + 0] == curr_idx) {
-					prev_idx = i;
+		if (events & TETRIS_OVER) {
+			clrscr();
+			out(STDOUT_FILENO, "\n\nYOU HAVE FAILED!\n\n");
+			show_score();
+			if (bot) {
+				/* Unattended demo or soak test, no high score, go again */
+				sleep(BOT_RESTART);
+				restart();
+				continue;
+			}
+			if (!undone)
+				show_high_score(game.points, game.level);
+			out(STDOUT_FILENO, "\n\nPress 'r' for replay or 'q' for quit!\n");
+			while ((c = getkey())) {
+				if (c == keys[KEY_QUIT] || c == keys[KEY_RESTART])
 					break;
-				}
 			}
-			shape = &shapes[5 * prev_idx];
-			if (!fits_in(shape, pos))
-				shape = backup;
-		}
-		
-		if (c == keys[KEY_RROTATE]) {
-			backup = shape;
-			shape = &shapes[5 * *shape];	/* Rotate */
-			/* Check if it fits, if not restore shape from backup */
-			if (!fits_in(shape, pos))
-				shape = backup;
+			if (c != keys[KEY_RESTART])
+				break;
+
+			restart();
+			continue;
 		}
 
-		if (c == keys[KEY_RIGHT]) {
-			if (!fits_in(shape, ++pos))
-				--pos;
+		if (c == keys[KEY_RESTART]) {
+			restart();
+			continue;
 		}
 
-		if (c == keys[KEY_DROP]) {
-			for (; fits_in(shape, pos + B_COLS); ++points)
-				pos += B_COLS;
+		if (c == keys[KEY_UNDO]) {
+			if (!tetris_undo(&history, &game)) {
+				replay_record(&rec, REPLAY_UNDO);
+				undone = 1;
+				dirty = 1;
+			}
+			continue;
 		}
 
-		if (c == keys[KEY_RESTART]) {
-			init(&c, &pos);
+#ifdef ENABLE_STATS
+		if (c == keys[KEY_STATS]) {
+			show_stats = !show_stats;
+			next_stats.tv_sec = next_stats.tv_nsec = 0;
+			show_online_help();
+			dirty = 1;
 			continue;
 		}
+#endif
 
 		if (c == keys[KEY_PAUSE] || c == keys[KEY_QUIT]) {
-			freeze(1);
-
 			if (c == keys[KEY_QUIT]) {
 				clrscr();
-				gotoxy(0, 0);
 
-				printf("\033[0mYour score: %ld points x level %d = %ld\n\n", points, level, points * level);
-				show_high_score();
+				show_score();
+				if (!bot && !undone)
+					show_high_score(game.points, game.level);
 				sleep(5);
 				break;
 			}
 
-			for (i = B_SIZE; i--; shadow[i] = 0)
-			   ;
-
-			while (getchar() - keys[KEY_PAUSE])
+			screen_invalidate(&scr);
+			dirty = 1;
+			while (running && getkey() - keys[KEY_PAUSE])
 			   ;
 
-			freeze(0);
+			gravity_resume();
 		}
-
-		place(shape, pos, color);
-		c = update();
-		place(shape, pos, 0);
 	}
 
+	replay_close(&rec);
 	clrscr();
 	if (tty_exit() == -1)
 		return 1;
+#ifdef ENABLE_STATS
+	stats_dump(stderr);
+#endif
 
 	return 0;
 }
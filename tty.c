@@ -0,0 +1,54 @@
+/* Micro Tetris, terminal modes of the ttys played on
+ *
+ * Copyright (c) 2025  julmajustus <julmajustus@tutanota.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "tty.h"
+
+/*
+ * Keys as they are typed, no echo, "stty cbreak -echo".  The modes are
+ * saved first, so if setting them fails tty_restore() still puts back
+ * whatever was changed.  Code stolen from http://c-faq.com/osdep/cbreak.html
+ */
+int tty_cbreak(struct tty *tty, int fd)
+{
+	struct termios modmodes;
+
+	tty->fd = fd;
+	tty->have = 0;
+	if (tcgetattr(fd, &tty->saved) < 0)
+		return -1;
+
+	tty->have = 1;
+
+	modmodes = tty->saved;
+	modmodes.c_lflag &= ~ICANON;
+	modmodes.c_lflag &= ~ECHO;
+	modmodes.c_cc[VMIN] = 1;
+	modmodes.c_cc[VTIME] = 0;
+
+	return tcsetattr(fd, TCSANOW, &modmodes) ? -1 : 0;
+}
+
+/* "stty sane", or rather the modes it had */
+int tty_restore(struct tty *tty)
+{
+	if (!tty->have)
+		return 0;
+
+	tty->have = 0;
+
+	return tcsetattr(tty->fd, TCSANOW, &tty->saved);
+}
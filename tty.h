@@ -0,0 +1,35 @@
+/* Micro Tetris, terminal modes of the ttys played on
+ *
+ * Copyright (c) 2025  julmajustus <julmajustus@tutanota.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#ifndef TETRIS_TTY_H_
+#define TETRIS_TTY_H_
+
+#include <termios.h>
+
+/*
+ * A tty taken over for a game, and the modes to give it back with.
+ * The front end has one on stdin, --kiosk one for each of its ttys.
+ */
+struct tty {
+	int            fd;		/* -1 when not taken */
+	struct termios saved;		/* as it was before */
+	int            have;		/* saved is valid, restore on exit */
+};
+
+int tty_cbreak  (struct tty *tty, int fd);
+int tty_restore (struct tty *tty);
+
+#endif /* TETRIS_TTY_H_ */